@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rng.h"
+
+// Picks index i with the probability weight[i] / sum of the weights in O(1), whatever the size.
+// Walker's alias method with Vose's construction: every column keeps itself with a probability
+// and gives the rest to its alias, building it is O(n) and it takes 8 bytes per entry
+struct alias_table {
+    uint32_t* keep; // the probability of keeping the column, in 1/2^32
+    uint32_t* alias;
+    size_t size;
+};
+
+// Negative weights count as 0, if all of them are 0 every index is just as likely
+_Bool alias_build(struct alias_table* t, const float* weight, size_t size);
+void alias_destroy(struct alias_table* t);
+
+size_t alias_pick(const struct alias_table* t, struct rng* r);
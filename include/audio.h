@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdio.h>
+
+// The sound effects, all of them are loaded up front
+enum sound {
+    SOUND_START,
+    SOUND_POP,
+    SOUND_END,
+    SOUNDS
+};
+
+// The default mixer buffer and the one used by --low-latency, in samples
+#define AUDIO_BUFFER_DEFAULT 4096
+#define AUDIO_BUFFER_LOW 256
+
+// Opens the mixer, the game works without audio so a failure isn't fatal
+_Bool audio_init(int buffer);
+// Decodes all the sounds, can run on another thread as long as nothing is played meanwhile
+void audio_load();
+void audio_dealloc();
+
+// Does nothing if the audio is not open
+void audio_play(enum sound s);
+
+// Prints the time from playing a sound to the mixer consuming it since the last report
+void audio_report(FILE* f);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <SDL.h>
+
+// The name that generates the background instead of loading an image
+#define BACKGROUND_PROCEDURAL "procedural"
+
+// The image (or BACKGROUND_PROCEDURAL) and whether it's stretched over the screen or repeated at its size.
+// The scale is the pixels per logical unit that a generated background is rendered for
+void background_configure(const char* file, _Bool tiled, float scale);
+
+// Loads or generates the pixels, doesn't need the renderer so it can run on any thread
+SDL_Surface* background_load();
+// Takes the surface over, a NULL background draws nothing
+_Bool background_upload(SDL_Surface* surf);
+void background_dealloc();
+
+// When the background covers the whole screen, the screen doesn't have to be cleared
+_Bool background_opaque();
+// The background scrolls with the time in ms, in a single draw call
+void background_draw(Uint32 time);
@@ -0,0 +1,4 @@
+#pragma once
+
+// Microbenchmarks, the arguments are the ones following --bench
+int bench_main(int argc, char* argv[]);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <SDL.h>
+
+// On renderers without acceleration every draw call blends on the CPU through SDL's generic paths,
+// so the compositor draws the frame into the pixels of one streaming texture instead and the
+// renderer only copies that. It covers the background, the glyphs, the particles and the HUD,
+// the few textures of the menus and the overlay are still drawn by the renderer on top of it
+
+// Whether the compositor is used, decided by the renderer or forced either way
+enum compose_mode {
+    COMPOSE_AUTO,
+    COMPOSE_ON,
+    COMPOSE_OFF
+};
+
+// The kernels that do the blending and the scaling
+enum compose_isa {
+    COMPOSE_SCALAR,
+    COMPOSE_SSE2,
+    COMPOSE_AVX2
+};
+
+// Call once the renderer exists and before the font and the background are uploaded,
+// they keep a copy of their pixels in memory for the compositor. Picks the fastest kernels
+void compose_init(enum compose_mode mode);
+void compose_dealloc();
+_Bool compose_enabled();
+
+// False if the CPU (or the build) doesn't have them
+_Bool compose_set_isa(enum compose_isa isa);
+enum compose_isa compose_isa();
+const char* compose_isa_name(enum compose_isa isa);
+
+// Starts a frame over the WIDTH x HEIGHT area, cleared to black if asked.
+// False if the compositor is off or failed, then everything goes to the renderer
+_Bool compose_begin(_Bool clear);
+// Copies the frame to the renderer, in one draw call
+void compose_end();
+// Between compose_begin and compose_end
+_Bool compose_active();
+
+// Blends the rectangle (in logical units) into the frame, or draws it with the renderer outside of a frame
+void compose_fill(SDL_FRect rect, SDL_Color col);
+// Blits the ARGB8888 surface scaled into the rectangle, blended unless the surface's blend mode is none.
+// The color modulates the pixels like the vertex colors of the renderer do. Only in a frame
+void compose_blit(SDL_Surface* src, const SDL_Rect* src_rect, SDL_FRect rect, SDL_Color col);
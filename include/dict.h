@@ -1,9 +1,72 @@
 #pragma once
 
 #include <stddef.h>
-#include <stdio.h>
+#include <stdint.h>
 
+// The most letters of a word plus one, the words are UTF-8 so they take up to WORDBYTES bytes
 #define    WORDLEN 12
+#define    WORDBYTES ((WORDLEN-1)*4+1)
 
-char** dict_load(FILE* f, size_t* size);
-void dict_destroy(char** dict, size_t size);
+// The version of the binary dictionary format, bump on every change
+#define    DICT_BIN_VERSION 3
+
+// The words are stored lowercased, in UTF-8 and NUL-terminated in a single arena,
+// everything lives in one allocation (or one mapping of a binary dictionary)
+struct dict {
+    char* arena;
+    uint32_t* offset; // where each word starts in the arena
+    uint8_t* len; // in bytes
+    uint16_t* width; // the pixel width of each word, NULL until measured
+    size_t size;
+
+    void* block;
+    size_t mapped; // the size of the mapping, 0 if the block is allocated
+    uint16_t* measured; // the widths computed by dict_measure, if they are not in the block
+    float* weight; // how often each word should come up, NULL if they all come up as often
+    float* parsed; // the weights of a word list, the binary ones are in the block
+};
+
+// Loads a UTF-8 word list, one word per whitespace-separated token. A number after a word
+// is its weight ("word weight" lines), the words without one weigh 1 if any word has a weight.
+// The words with anything else than letters (see utf8_letter) are left out
+_Bool dict_load(struct dict* d, const char* filename);
+
+// Loads a dictionary compiled by dictc without parsing it. If the widths were computed
+// with different glyph widths than the given ones, they are left out. Fails if the word list
+// it was compiled from (source, may be NULL) exists and its size or modification time has changed since.
+// The file is trusted input, it's built with the game (make dict): only its header and its total size
+// are checked, a damaged offset or length of a word makes dict_word read outside of the mapping
+_Bool dict_load_bin(struct dict* d, const char* filename, const char* source, const uint8_t glyph_width[26]);
+_Bool dict_save_bin(const struct dict* d, const char* filename, const char* source, const uint8_t glyph_width[26]);
+
+// Computes the width of every word from the glyph widths, unless the dictionary already has them.
+// The letters other than a-z are measured by other_width
+_Bool dict_measure(struct dict* d, const uint8_t glyph_width[26], unsigned (*other_width)(uint32_t cp));
+
+void dict_destroy(struct dict* d);
+
+static inline const char* dict_word(const struct dict* d, size_t i) {
+    return d->arena + d->offset[i];
+}
+
+// The pairs of consecutive letters, ab is 'a'*26 + 'b' (as 0-25). Only the pairs of a-z are indexed
+#define    BIGRAMS (26*26)
+// The postings of a bigram are split into blocks of this many, each one can be decoded on its own
+#define    BIGRAM_BLOCK 32
+
+// For every bigram, the words that contain it. The word IDs of a bigram are sorted and stored
+// as varint deltas, the first ID of every block is in the skip list with the block's offset,
+// so the k-th word of any bigram is at most BIGRAM_BLOCK-1 deltas away
+struct bigram_index {
+    uint32_t count[BIGRAMS]; // the words of every bigram
+    uint32_t skip_start[BIGRAMS+1]; // where the blocks of every bigram start in skip_id and skip_offset
+    uint32_t* skip_id, *skip_offset;
+    uint8_t* data;
+    size_t size; // of data
+};
+
+_Bool bigram_index_build(struct bigram_index* idx, const struct dict* d);
+void bigram_index_destroy(struct bigram_index* idx);
+
+// The k-th word that contains the bigram, k < count[bigram]
+uint32_t bigram_index_get(const struct bigram_index* idx, size_t bigram, size_t k);
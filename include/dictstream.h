@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <SDL.h>
+
+#include "dict.h"
+#include "rng.h"
+#include "wordpool.h"
+
+// The default size of the working set of a streamed corpus
+#define    DICT_STREAM_WORDS 65536
+
+// A word list of any size (gzip or zstd compressed too, when built with them) read on a background
+// thread. Only a sampled working set of it is ever in memory, it lives in a dictionary with fixed
+// WORDLEN slots, and the thread keeps sampling new words into it. A plain word list starts with
+// the words after random offsets, a compressed one can only be read in order and starts with its first
+// words until the first pass is through it. After that the set is a uniform sample of the last pass
+struct dict_stream {
+    const char* filename;
+    size_t capacity;
+    uint8_t glyph_width[26];
+
+    SDL_Thread* thread;
+    SDL_mutex* lock;
+    SDL_cond* ready_cond;
+
+    // Everything below is guarded by the lock
+    char (*sample)[WORDLEN]; // the newest sample of every slot
+    uint32_t* queue; // the slots whose sample isn't in the dictionary yet, a ring
+    uint8_t* queued;
+    size_t queue_head, queue_len;
+
+    size_t filled; // the slots that have a word at all
+    _Bool ready, failed, quit;
+};
+
+// Starts streaming, returns once the working set is full (or the whole corpus is in it)
+_Bool dict_stream_open(struct dict_stream* s, struct dict* d, const char* filename, size_t capacity,
+                       const uint8_t glyph_width[26]);
+// Moves at most budget new samples into the dictionary, only in place of the words that are unused
+// in the pool, so nothing on the screen changes. Never waits for the thread
+void dict_stream_refill(struct dict_stream* s, struct dict* d, const struct wordpool* pool, size_t budget);
+// Stops the thread, the dictionary stays valid until dict_destroy
+void dict_stream_close(struct dict_stream* s);
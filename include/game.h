@@ -1,16 +1,143 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <SDL.h>
 
+#include "dict.h"
+#include "matcher.h"
+#include "rng.h"
+#include "stats.h"
+#include "wordpool.h"
+
 #define NUM_SCORES 6
 
+// The length of one simulation tick in milliseconds
+#define TICK_MS 10
+
+// The number of the slowest bigrams that the adaptive picks go for
+#define WEAK_BIGRAMS 4
+
+// The word stream of one player, a structure of arrays of game_stream_size() words
+struct word_stream {
+    float* x, *y;
+    float* prev_x; // the position before the last tick, for interpolation
+    uint32_t* index; // index in the dict array
+    uint16_t* width; // the pixel width of the word
+    uint16_t* lane;
+};
+
+// One player's round. The dictionary is shared by all of them, everything else is their own,
+// so any number of players can play side by side. With the same seed they start with the same
+// stream, after that every round only depends on its own inputs
+struct game {
+    struct wordpool unused; // the words that are not in the word stream
+    struct rng rng;
+    struct matcher matcher;
+
+    struct word_stream stream;
+
+    char input[WORDBYTES]; // UTF-8
+
+    // The speed of the word stream, in pixels per tick
+    double scroll_speed;
+
+    // Scores
+    unsigned cpm; // the chars per minute (in the last minute)
+    unsigned cpm_best; // the overall best cpm
+    unsigned backspaces; // the number of input character deletions
+    unsigned words, chars; // Total characters and words typed in this round
+    Uint32 round_start; // When the current round started
+
+    // The simulated time in milliseconds, advanced by TICK_MS every tick
+    Uint32 time;
+
+    // The random seed, 0 seeds from the clock
+    unsigned seed;
+
+    // The characters of the words typed in the last minute, for the CPM
+    struct stats_window cpm_window;
+
+    // The time between the two keys of every bigram typed within a word, for the adaptive picks
+    uint32_t bigram_ms[BIGRAMS];
+    uint16_t bigram_count[BIGRAMS];
+    uint32_t last_key; // 0 at the start of a word, after a correction and after a letter that isn't a-z
+    Uint32 last_key_time;
+    // The slowest bigrams and the number of words that have them
+    uint16_t weak[WEAK_BIGRAMS];
+    size_t weak_count, weak_words;
+
+    // Only the game on the screen makes particles and sounds
+    _Bool visible;
+};
+
+// What the renderer needs of a game, copied at the end of the ticks so that it can be drawn
+// on another thread while the next ticks are simulated. Only the words that can be on the screen are in it
+struct game_snapshot {
+    size_t words, words_cap;
+    float* x, *prev_x, *y;
+    char (*word)[WORDBYTES]; // a copy, a streamed corpus can replace the dictionary's word while it's drawn
+    uint16_t* width;
+    uint8_t* highlight; // how many letters are typed
+
+    size_t particles, particles_cap;
+    float* particle_x, *particle_y, *particle_vx;
+
+    char input[WORDBYTES];
+
+    unsigned cpm, cpm_best, backspaces, words_typed, chars;
+    Uint32 survived; // the time since the round started
+};
+
+// The dictionary and everything else the players share
 _Bool game_init();
 void game_dealloc();
 
-void game_start();
-_Bool game_draw();
+// A player, call after game_init
+_Bool game_create(struct game* g);
+void game_destroy(struct game* g);
+
+void game_start(struct game* g);
+
+// Advances the simulation by one tick, returns false if we lost
+_Bool game_update(struct game* g);
+// Copies the state that is drawn, returns false if it ran out of memory
+_Bool game_snapshot(const struct game* g, struct game_snapshot* snap);
+void game_snapshot_destroy(struct game_snapshot* snap);
+// Draws the state interpolated between the last two ticks, alpha is in [0, 1]
+void game_draw(const struct game_snapshot* snap, double alpha);
+
+// The input is UTF-8, only the letters are taken and they are lowercased
+void game_textinput(struct game* g, const char* str);
+// Deletes the last num letters
+void game_input_delete(struct game* g, size_t num);
+
+void game_render_scores(const struct game_snapshot* snap, SDL_Texture* rows[NUM_SCORES]);
+void game_score(const struct game* g, unsigned* words, unsigned* chars, unsigned* cpm_best);
+
+// Headless runs use a fixed seed, 0 means seeding from the clock
+void game_set_seed(struct game* g, unsigned seed);
+// The number of words in the stream, 16 by default, call before game_init
+void game_set_words(size_t count);
+// The slots of the CPM window, a game needs one for every tick of the last minute that a word was typed at.
+// STATS_SLOTS by default, which is enough for every tick. Call before game_create
+void game_set_window(size_t slots);
+// Every other word is picked among the ones with the bigrams the player types the slowest,
+// call before game_init
+void game_set_adaptive(_Bool adaptive);
+_Bool game_adaptive();
+
+// Streams the words from a word list of any size instead, keeping the given number of them (0 for the default)
+// in memory, call before game_init. The rounds are not reproducible with it, and only one player can play
+void game_set_corpus(const char* filename, size_t words);
 
-void game_textinput(const char* str);
-void game_input_delete(size_t num);
+// The number of ticks since the round started
+unsigned game_tick(const struct game* g);
+// What a replay needs to match
+size_t game_stream_size();
+size_t game_dict_size();
 
-void game_render_scores(SDL_Texture* rows[NUM_SCORES]);
+// The current input and the rightmost word that can be typed, NULL if none is visible
+const char* game_input(const struct game* g);
+const char* game_target(const struct game* g);
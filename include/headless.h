@@ -0,0 +1,5 @@
+#pragma once
+
+// Runs the game without a window against a simulated clock, with a scripted typist,
+// and prints the frame timings. The arguments are the ones following --headless.
+int headless_main(int argc, char* argv[]);
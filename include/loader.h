@@ -0,0 +1,25 @@
+#pragma once
+
+#include <SDL.h>
+
+// The startup work that doesn't need the renderer, every job gets its own thread
+enum load_job {
+    LOAD_WORDS, // the font and the glyphs, then the dictionary and the game (game_init)
+    LOAD_SOUNDS,
+    LOAD_BACKGROUND, // loaded or generated by background_load
+    LOAD_JOBS
+};
+
+// Starts all the jobs, the audio has to be opened and the game and the background configured before
+_Bool loader_start();
+
+// Never waits, a finished job is joined the first time it's seen finished
+_Bool loader_done(enum load_job job);
+// Only valid once the job is done
+_Bool loader_ok(enum load_job job);
+
+// The decoded background image, the caller takes it over
+SDL_Surface* loader_background();
+
+// Waits for the jobs that are still running, for quitting during the loading
+void loader_wait();
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "replay.h"
+
+// The ticks between typing a key and the tick it's played at, so that it reaches everyone in time
+#define    LOCKSTEP_DELAY 4
+
+// A race of several players over the same stream. Every client simulates every player's game,
+// the games are deterministic, so only the inputs go over the wire, in the replay encoding.
+// The clients talk to a host that relays the inputs, every client only has one connection
+// and the host merges everything into a single message per client per relay.
+//
+// The wire is a byte stream, the messages delimit themselves:
+//   client to host: varint promise delta, varint length, the new events of the player
+//   host to client: varint known delta, then for every other player with new events
+//                   varint player+1, varint length, the events, and a 0 at the end
+// A player "promises" a tick when it has sent all its inputs before it. The host tells the clients
+// the smallest promise, every game can be simulated up to it.
+
+// One direction of a connection. This is the loopback, a socket would carry the same bytes,
+// in whatever pieces it delivers them
+struct lockstep_link {
+    uint8_t* data;
+    size_t size, cap, read;
+    uint64_t bytes; // everything that was ever sent over it
+};
+
+struct lockstep_host {
+    size_t players;
+    struct lockstep_link* up, *down; // one of both for every player
+    struct lockstep_link* pending; // the events of every player since the last relay
+    uint32_t* promised;
+    uint32_t announced; // the smallest promise the clients know about
+};
+
+struct lockstep_client {
+    size_t player, players;
+    struct lockstep_link* up, *down;
+
+    struct replay local; // this player's inputs that aren't sent yet
+    uint32_t promised;
+
+    // The inputs of every player before this tick have arrived
+    uint32_t known;
+    // Every player's inputs, play them back into their game with replay_apply
+    struct replay* inputs;
+};
+
+_Bool lockstep_host_init(struct lockstep_host* h, size_t players);
+void lockstep_host_destroy(struct lockstep_host* h);
+// Reads what the clients sent and passes it on, returns false if a client sent garbage.
+// A message that has only partly arrived is read once the rest is there
+_Bool lockstep_host_relay(struct lockstep_host* h);
+
+// Connects to the host as the given player
+_Bool lockstep_join(struct lockstep_client* c, struct lockstep_host* h, size_t player);
+void lockstep_leave(struct lockstep_client* c);
+
+// The local inputs at the current tick, they are played LOCKSTEP_DELAY ticks later
+_Bool lockstep_text(struct lockstep_client* c, uint32_t tick, const char* str);
+_Bool lockstep_delete(struct lockstep_client* c, uint32_t tick, size_t num);
+// Sends the new inputs, call once a frame after the inputs of the current tick
+_Bool lockstep_flush(struct lockstep_client* c, uint32_t tick);
+// Reads what the host sent, returns false if it was garbage. Like the host, it waits for the rest
+// of a message that has only partly arrived
+_Bool lockstep_poll(struct lockstep_client* c);
+
+// Whether the inputs of all the players are there for the tick
+static inline _Bool lockstep_ready(const struct lockstep_client* c, uint32_t tick) {
+    return tick < c->known;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "dict.h" // WORDLEN
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MATCHER_NONE ((size_t)-1)
+
+// Matches the typed input against the words in the stream incrementally.
+// The stream words are kept in a trie and the input is a position in it,
+// so typing and deleting a character is O(1), and so is asking how much
+// of a word matches the input. Inserting and removing words is O(WORDLEN).
+// The characters are codepoints, a-z are children of the node itself
+// and the children by any other letter are in a hash table of the edges.
+
+struct node {
+    uint32_t child[26]; // ROOT means no child, the root is never anyone's child
+    uint32_t parent;
+    uint32_t refs; // the number of words going through this node, 0 means free
+    uint32_t ends; // the first slot whose word ends here
+    uint32_t letter; // the codepoint on the way from the parent
+};
+
+// A child that isn't a-z, ROOT as the child means the entry is free
+struct edge {
+    uint32_t parent, letter, child;
+};
+
+struct slot {
+    uint32_t path[WORDLEN]; // path[d] is the node of the first d characters
+    uint32_t len;
+    uint32_t prev_end, next_end; // the list of the slots ending at the same node
+    _Bool used;
+};
+
+// Every player has their own matcher
+struct matcher {
+    struct node* nodes;
+    uint32_t* free_nodes; // a stack of the free nodes
+    size_t free_count, node_count;
+
+    struct slot* slots;
+    size_t slot_count;
+
+    // Open addressing with linear probing, at most half full
+    struct edge* edges;
+    size_t edge_mask;
+
+    // The input, its path is the same as a slot's, but it can be longer than the path
+    // when the input diverged from all the words
+    uint32_t input[WORDLEN];
+    size_t input_len;
+    uint32_t input_path[WORDLEN];
+    size_t matched_len; // the length of input_path
+};
+
+_Bool matcher_init(struct matcher* m, size_t slots);
+void matcher_destroy(struct matcher* m);
+
+// Removes all the words and clears the input
+void matcher_reset(struct matcher* m);
+
+// The word is UTF-8
+void matcher_insert(struct matcher* m, size_t slot, const char* word);
+void matcher_remove(struct matcher* m, size_t slot);
+
+void matcher_push(struct matcher* m, uint32_t cp);
+void matcher_pop(struct matcher* m);
+void matcher_clear_input(struct matcher* m);
+
+// The number of leading letters of the slot's word that agree with the input, if all of them do, else 0
+size_t matcher_highlight(const struct matcher* m, size_t slot);
+
+// The slots whose word is exactly the input, MATCHER_NONE terminates the list
+size_t matcher_first_match(const struct matcher* m);
+size_t matcher_next_match(const struct matcher* m, size_t slot);
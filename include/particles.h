@@ -1,5 +1,14 @@
 #pragma once
 
+#include <stddef.h>
+
+// The particles are integrated by the simulation, the renderer draws a copy of them
 void particles_reset();
 void particles_start(int x, int y);
-void particles_draw();
+void particles_update();
+size_t particles_count();
+// The arrays have room for particles_count() particles
+void particles_copy(float* x, float* y, float* vx);
+// The horizontal speed decides how bright a particle is
+void particles_draw(const float* x, const float* y, const float* vx, size_t n);
+void particles_dealloc();
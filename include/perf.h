@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdio.h>
+
+#include <SDL.h>
+
+// Render statistics of the current frame, the main loop resets them every frame
+struct perf_counters {
+    unsigned draw_calls; // SDL_RenderCopy/FillRect/Geometry/Clear calls
+    unsigned texture_uploads; // textures created from surfaces
+    unsigned texture_queries; // SDL_QueryTexture calls, the sizes should be cached instead
+    unsigned label_hits, label_misses; // text labels reused/rendered again
+    unsigned glyph_misses, glyph_evictions; // glyphs rasterized into an atlas/atlas shelves emptied for them
+    unsigned composed; // fills and blits done on the CPU by the compositor
+};
+
+extern struct perf_counters perf;
+
+// The timed parts of a frame, a phase can be entered multiple times per frame
+enum perf_phase {
+    PERF_UPDATE,
+    PERF_BACKGROUND,
+    PERF_WORDS,
+    PERF_PARTICLES,
+    PERF_HUD,
+    PERF_PRESENT,
+    PERF_PHASES
+};
+
+void perf_begin(enum perf_phase phase);
+void perf_end(enum perf_phase phase);
+
+// Call at the start of the frame, and after the frame has been presented
+void perf_frame_begin();
+void perf_frame_end();
+// Call for every input event, the latency is measured until the next frame is presented
+void perf_input(Uint32 timestamp);
+void perf_reset();
+void perf_report(FILE* f);
+
+// Writes every frame to the file, as Chrome trace JSON if the name ends with .json, else as CSV
+_Bool perf_trace_open(const char* filename);
+// Flushes and closes the trace
+void perf_dealloc();
+
+// The overlay with the frame time percentiles of the last frames
+void perf_overlay_toggle();
+void perf_overlay_draw(int x, int y);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The version of the replay format, bump on every change of the format or the scoring
+#define    REPLAY_VERSION 4
+
+struct game;
+
+// One round of the game: the seed and every input with the tick it came in at, so that playing
+// it back through the game reproduces the round exactly. The events are kept encoded,
+// a varint of the ticks since the previous event followed by the event itself
+struct replay {
+    uint32_t seed;
+    uint32_t stream_size, dict_size; // the round only replays with the same stream and dictionary
+    uint32_t adaptive; // whether the words were picked by the player's slow bigrams
+
+    // The final score, filled in when the round ends
+    uint32_t ticks; // the tick the round was lost at
+    uint32_t words, chars, cpm_best;
+
+    uint8_t* data;
+    size_t size, cap;
+
+    // Where the recording or the playback is
+    size_t pos;
+    uint32_t last_tick;
+};
+
+// Starts recording a round that is played with the given seed, with the current game settings
+void replay_begin(struct replay* r, uint32_t seed, uint32_t stream_size, uint32_t dict_size);
+void replay_destroy(struct replay* r);
+
+// Record the inputs at the current tick
+_Bool replay_text(struct replay* r, uint32_t tick, const char* str);
+_Bool replay_delete(struct replay* r, uint32_t tick, size_t num);
+// Records the final score of the round
+void replay_end(struct replay* r, const struct game* g);
+
+_Bool replay_save(const struct replay* r, const char* filename);
+_Bool replay_load(struct replay* r, const char* filename);
+
+// Adds events that were recorded elsewhere (by replay_text and replay_delete) to the end of the playback,
+// the playback may reach the end and continue once more of them are appended
+_Bool replay_append(struct replay* r, const uint8_t* data, size_t size);
+
+// Goes back to the start of the playback
+void replay_rewind(struct replay* r);
+// Feeds all the inputs up to the game's current tick to it, call before every game_update
+void replay_apply(struct replay* r, struct game* g);
+// Compares the score of the finished round to the recorded one
+_Bool replay_verify(const struct replay* r, const struct game* g);
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+
+// xoshiro256** pseudorandom generator, seeded through splitmix64
+struct rng {
+    uint64_t s[4];
+};
+
+void rng_seed(struct rng* r, uint64_t seed);
+uint64_t rng_next(struct rng* r);
+
+// Uniform in [0, n), n must not be 0
+uint64_t rng_range(struct rng* r, uint64_t n);
+// Uniform in [0, 1)
+double rng_double(struct rng* r);
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <SDL.h>
+
+#include "game.h"
+#include "replay.h"
+#include "stats.h"
+
+// The inputs that can wait for the simulation, more than anyone types between two ticks
+#define    SIM_QUEUE 256
+
+// The simulation thread runs the ticks of a game on its own clock, so a frame that is late
+// to present never holds back the ticks or the typed words. The renderer only talks to it
+// through two lock-free structures:
+//   the inputs go in through a single producer, single consumer ring,
+//   the state comes out as game snapshots through a triple buffer, the thread fills one,
+//   the renderer draws another and the third one is the newest complete one.
+// The game must not be touched by anyone else while the thread runs, except when the frame says
+// the round is lost, then it's left alone until sim_play
+
+enum sim_input_type {
+    SIM_TEXT,
+    SIM_DELETE,
+    SIM_PLAY
+};
+
+struct sim_input {
+    enum sim_input_type type;
+    unsigned num; // the letters to delete, the seed to play with (0 keeps the game's)
+    char text[32]; // the same as in SDL_TextInputEvent
+};
+
+struct sim_frame {
+    struct game_snapshot game;
+    unsigned round; // the number of sim_play calls that the thread has seen
+    _Bool lost; // the round is over, the game can be read until the next round
+    Uint64 ticked; // the performance counter at the last tick, to interpolate from
+    struct histogram late; // how late the ticks ran, in microseconds
+};
+
+struct sim {
+    struct game* game;
+    struct replay* record; // the inputs of the rounds are recorded into it, if given
+    struct replay* replay; // or played back from it instead of the inputs
+
+    SDL_Thread* thread;
+    SDL_atomic_t running;
+    SDL_sem* wake; // the inputs wake the thread up before the next tick
+
+    struct sim_input queue[SIM_QUEUE];
+    SDL_atomic_t head, tail; // written by the renderer and the thread
+    unsigned dropped; // the inputs that didn't fit, the renderer's
+
+    struct sim_frame frames[3];
+    SDL_atomic_t latest; // the newest complete frame, with SIM_FRESH if the renderer hasn't seen it
+    int back, front; // the thread's and the renderer's
+};
+
+// Starts the thread, the game has to be created already
+_Bool sim_open(struct sim* s, struct game* g, struct replay* record, struct replay* replay);
+// Stops the thread, the game is left as it was
+void sim_close(struct sim* s);
+
+// The inputs of the renderer's thread, false if the queue was full. A round has no inputs before sim_play
+_Bool sim_play(struct sim* s, unsigned seed);
+_Bool sim_text(struct sim* s, const char* text);
+_Bool sim_delete(struct sim* s, unsigned num);
+
+// The newest frame, it's the renderer's and doesn't change until the next call
+const struct sim_frame* sim_frame(struct sim* s);
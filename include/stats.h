@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The events that happened at most STATS_SPAN ms ago, the events of the same ms are merged into one.
+// With the simulation clock there is at most one entry per tick, so a ring of STATS_SLOTS never fills up.
+// A smaller one merges the events into the newest one once it's full
+#define STATS_SPAN 60000
+#define STATS_SLOTS 8192
+
+struct stats_window {
+    uint32_t* time, *count;
+    size_t slots;
+    size_t head, len;
+    uint64_t sum;
+};
+
+_Bool stats_window_init(struct stats_window* w, size_t slots);
+void stats_window_destroy(struct stats_window* w);
+void stats_window_reset(struct stats_window* w);
+// The time must not go backwards
+void stats_window_add(struct stats_window* w, uint32_t now, uint32_t count);
+// The exact sum over (now - STATS_SPAN, now], the expired events are dropped here,
+// each of them exactly once, so this is amortized O(1)
+uint64_t stats_window_sum(struct stats_window* w, uint32_t now);
+
+// A log-linear histogram, the values below 32 are exact and the larger ones
+// are within 1/16 of their bucket, any uint32_t value fits in a fixed size
+#define HISTOGRAM_BUCKETS 464
+
+struct histogram {
+    uint32_t bucket[HISTOGRAM_BUCKETS];
+    uint64_t count, sum;
+    uint32_t max;
+};
+
+void histogram_reset(struct histogram* h);
+void histogram_add(struct histogram* h, uint32_t value);
+// The smallest value that at least the fraction p of the values are below or equal to, 0 if empty
+uint32_t histogram_percentile(const struct histogram* h, double p);
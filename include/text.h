@@ -1,14 +1,50 @@
 #pragma once
 
+#include <stdint.h>
+
 #include <SDL.h>
 #include <SDL_ttf.h>
 
+// The font that the whole game (and the dictionary compiler) uses
+#define FONT_FILE "res/font.ttf"
+#define FONT_SIZE 32
+
 _Bool font_init();
 void font_dealloc();
+// font_init in two steps: the font and the glyphs can be rasterized on any thread,
+// only the upload of the atlas has to happen on the thread of the renderer
+_Bool font_load();
+_Bool font_upload();
+
+// The pixels per logical unit of the window, the text is rasterized at the pixel size
+// so that it's drawn 1:1 at any scale. The scale of the text is relative to FONT_SIZE
+void text_set_pixel_scale(float scale);
+float text_pixel_scale();
 
-unsigned render_char_cached(size_t apb_index, const char c, int x, int y, double scale);
-void render_string_cached(size_t apb_index, const char* str, int x, int y, double scale);
+// Queues the glyph of the codepoint into the atlas batch, nothing is drawn until render_cached_flush.
+// The atlas of every size fills up as the glyphs are first drawn, and the least recently drawn ones
+// make room for new ones when it's full
+float render_char_cached(size_t apb_index, uint32_t cp, float x, float y, double scale);
+void render_cached_flush();
+// The strings are UTF-8
+void render_string_cached(size_t apb_index, const char* str, float x, float y, double scale);
 unsigned cached_string_width(size_t apb_index, const char* str);
+// The widths of a-z at FONT_SIZE, to check that precomputed word widths still match the font
+void glyph_widths(uint8_t widths[26]);
+// The width of any glyph at FONT_SIZE
+unsigned glyph_advance(uint32_t cp);
+
+// The texture is in pixels, its logical size is its size divided by the pixel scale
+SDL_Texture* string_cache(const char* str, SDL_Color col, double scale);
+void render_string(const char* str, float x, float y, double scale);
+
+// A white string texture that is only rendered again when its text changes
+struct text_label {
+    char str[64];
+    SDL_Texture* tex;
+    SDL_Surface* surf; // instead of the texture when it's drawn into a composited frame
+    int w, h, px;
+};
 
-SDL_Texture* string_cache(const char* str, SDL_Color col);
-void render_string(const char* str, int x, int y, double scale);
+void render_label(struct text_label* label, const char* str, float x, float y, double scale);
+void label_destroy(struct text_label* label);
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The most bytes a codepoint takes
+#define    UTF8_MAX 4
+
+// What utf8_decode returns for a byte sequence that isn't UTF-8
+#define    UTF8_INVALID UINT32_MAX
+
+// Decodes the codepoint at *s and moves past it, the bytes end at end.
+// Overlong forms, surrogates and truncated sequences are UTF8_INVALID, and only one byte is skipped
+uint32_t utf8_decode(const char** s, const char* end);
+
+// Writes the codepoint, returns the number of bytes (0 if it isn't one)
+size_t utf8_encode(uint32_t cp, char out[UTF8_MAX]);
+
+// The lowercase form of a letter, 0 if the codepoint isn't one. The letters are a-z and the
+// Latin, Greek and Cyrillic ones, which covers the word lists we have. The lowercase form
+// always takes as many bytes as the codepoint itself
+uint32_t utf8_letter(uint32_t cp);
+
+// The number of codepoints of a string
+size_t utf8_length(const char* s);
+
+// Where the last codepoint of the first len bytes starts
+size_t utf8_back(const char* s, size_t len);
+
+// The codepoint at *s of a string that is known to be valid (the dictionary's and the input),
+// ASCII takes a single branch
+static inline uint32_t utf8_next(const char** s) {
+    const unsigned char* c = (const unsigned char*)*s;
+
+    if (c[0] < 0x80) {
+        (*s)++;
+        return c[0];
+    }
+    if (c[0] < 0xE0) {
+        *s += 2;
+        return (c[0] & 0x1F) << 6 | (c[1] & 0x3F);
+    }
+    if (c[0] < 0xF0) {
+        *s += 3;
+        return (c[0] & 0x0F) << 12 | (c[1] & 0x3F) << 6 | (c[2] & 0x3F);
+    }
+    *s += 4;
+    return (uint32_t)(c[0] & 0x07) << 18 | (c[1] & 0x3F) << 12 | (c[2] & 0x3F) << 6 | (c[3] & 0x3F);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rng.h"
+
+// The set of dictionary words that are not on the screen, picking and releasing is O(1).
+// The words array is a permutation of all the words, the unused ones are in [0, unused).
+// 32 bit indices keep the two arrays small enough to stay in the cache for longer
+struct wordpool {
+    uint32_t* words;
+    uint32_t* slot; // where each word is in the words array
+    size_t size, unused;
+};
+
+_Bool wordpool_init(struct wordpool* p, size_t size);
+void wordpool_destroy(struct wordpool* p);
+
+// Marks all the words as unused and puts them back in their initial order, O(n)
+void wordpool_reset(struct wordpool* p);
+
+// Picks a uniformly random unused word and marks it as used,
+// if all of them are used, a random used word is returned
+size_t wordpool_pick(struct wordpool* p, struct rng* r);
+// Marks the given word as used, returns false if it already was
+_Bool wordpool_take(struct wordpool* p, size_t word);
+void wordpool_release(struct wordpool* p, size_t word);
@@ -0,0 +1,78 @@
+#include "alias.h"
+
+#include <stdlib.h> // malloc
+#include <string.h> // memset
+
+_Bool alias_build(struct alias_table* t, const float* weight, size_t size) {
+    memset(t, 0, sizeof(*t));
+    if (size == 0 || size > UINT32_MAX) return 0;
+
+    t->keep = malloc(size * sizeof(uint32_t));
+    t->alias = malloc(size * sizeof(uint32_t));
+    // The scaled weights and the work lists, the small columns are stacked from the front
+    // and the large ones from the back, so one array holds both
+    double* p = malloc(size * sizeof(double));
+    uint32_t* work = malloc(size * sizeof(uint32_t));
+    if (!t->keep || !t->alias || !p || !work) {
+        free(p);
+        free(work);
+        alias_destroy(t);
+        return 0;
+    }
+    t->size = size;
+
+    double sum = 0;
+    for (size_t i = 0; i < size; i++)
+        sum += weight[i] > 0 ? weight[i] : 0;
+
+    // Scaled so that the average column is exactly full
+    size_t small = 0, large = size;
+    for (size_t i = 0; i < size; i++) {
+        p[i] = sum > 0 ? (weight[i] > 0 ? weight[i] : 0) * size / sum : 1;
+        if (p[i] < 1) work[small++] = i;
+        else work[--large] = i;
+    }
+
+    // Fill every small column up from a large one, which may become small itself
+    while (small > 0 && large < size) {
+        uint32_t s = work[--small], l = work[large];
+
+        t->keep[s] = (uint32_t)(p[s] * 4294967296.0);
+        t->alias[s] = l;
+
+        p[l] -= 1 - p[s];
+        if (p[l] < 1) {
+            large++;
+            work[small++] = l;
+        }
+    }
+
+    // What's left is full, up to the rounding errors
+    while (small > 0) {
+        uint32_t s = work[--small];
+        t->keep[s] = UINT32_MAX;
+        t->alias[s] = s;
+    }
+    for (; large < size; large++) {
+        uint32_t l = work[large];
+        t->keep[l] = UINT32_MAX;
+        t->alias[l] = l;
+    }
+
+    free(p);
+    free(work);
+    return 1;
+}
+
+void alias_destroy(struct alias_table* t) {
+    free(t->keep);
+    free(t->alias);
+    memset(t, 0, sizeof(*t));
+}
+
+size_t alias_pick(const struct alias_table* t, struct rng* r) {
+    size_t column = rng_range(r, t->size);
+    uint32_t coin = rng_next(r) >> 32;
+
+    return coin < t->keep[column] ? column : t->alias[column];
+}
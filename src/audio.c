@@ -0,0 +1,131 @@
+#include "audio.h"
+
+#include <SDL.h>
+#include <SDL_mixer.h>
+
+// The start and end sounds have their own channels, the pops rotate through the rest,
+// so fast typing can never cut off the other sounds
+#define CHANNEL_START 0
+#define CHANNEL_END 1
+#define POP_FIRST 2
+#define POP_LAST 7
+#define POP_GROUP 1
+
+static const char* sound_file[SOUNDS] = {
+    [SOUND_START] = "res/start.wav",
+    [SOUND_POP] = "res/pop.wav",
+    [SOUND_END] = "res/end.wav"
+};
+
+static Mix_Chunk* sounds[SOUNDS];
+static _Bool audio_open = 0;
+static int frequency, buffer_samples;
+
+// The play time of the sound on every channel, the mixer thread takes it on the first mixed block
+static struct channel_probe {
+    SDL_atomic_t pending;
+    Uint64 played;
+} probes[POP_LAST+1];
+
+// Written by the mixer thread, in microseconds
+static SDL_atomic_t latency_count, latency_sum, latency_max;
+
+static void probe_effect(int chan, void* stream, int len, void* udata) {
+    (void)chan; (void)stream; (void)len;
+    struct channel_probe* p = udata;
+
+    if (!SDL_AtomicCAS(&p->pending, 1, 0)) return;
+
+    int us = (int)((SDL_GetPerformanceCounter() - p->played) * 1000000 / SDL_GetPerformanceFrequency());
+    SDL_AtomicAdd(&latency_count, 1);
+    SDL_AtomicAdd(&latency_sum, us);
+
+    int max;
+    do max = SDL_AtomicGet(&latency_max);
+    while (us > max && !SDL_AtomicCAS(&latency_max, max, us));
+}
+
+_Bool audio_init(int buffer) {
+    // Mono is enough for the few effects
+    if (Mix_OpenAudio(MIX_DEFAULT_FREQUENCY, MIX_DEFAULT_FORMAT, 1, buffer)) {
+        fprintf(stderr, "SDL_Mixer failed to initialize : %s\n", Mix_GetError());
+        return 0;
+    }
+
+    Uint16 format;
+    int channels;
+    Mix_QuerySpec(&frequency, &format, &channels);
+    buffer_samples = buffer;
+
+    Mix_AllocateChannels(POP_LAST+1);
+    Mix_ReserveChannels(POP_FIRST);
+    Mix_GroupChannels(POP_FIRST, POP_LAST, POP_GROUP);
+
+    audio_open = 1;
+    return 1;
+}
+
+void audio_load() {
+    if (!audio_open) return;
+
+    // Decoded once, playing a sound never touches the disk
+    for (int i = 0; i < SOUNDS; i++)
+        if (!(sounds[i] = Mix_LoadWAV(sound_file[i])))
+            fprintf(stderr, "Failed to load %s : %s\n", sound_file[i], Mix_GetError());
+}
+
+void audio_dealloc() {
+    if (!audio_open) return;
+
+    Mix_HaltChannel(-1);
+    for (int i = 0; i < SOUNDS; i++) {
+        Mix_FreeChunk(sounds[i]);
+        sounds[i] = NULL;
+    }
+
+    Mix_CloseAudio();
+    audio_open = 0;
+}
+
+void audio_play(enum sound s) {
+    if (!audio_open || !sounds[s]) return;
+
+    int chan;
+    switch (s) {
+        case SOUND_START : chan = CHANNEL_START; break;
+        case SOUND_END : chan = CHANNEL_END; break;
+        default :
+            // Steal the oldest pop when all of them are playing
+            if ((chan = Mix_GroupAvailable(POP_GROUP)) < 0)
+                chan = Mix_GroupOldest(POP_GROUP);
+        break;
+    }
+
+    // Halting drops the effects of the channel, the probe has to be registered after it,
+    // but before playing, so that the first mixed block can't be missed
+    Mix_HaltChannel(chan);
+
+    struct channel_probe* p = &probes[chan];
+    p->played = SDL_GetPerformanceCounter();
+    SDL_AtomicSet(&p->pending, 1);
+    Mix_RegisterEffect(chan, probe_effect, NULL, p);
+
+    Mix_PlayChannel(chan, sounds[s], 0);
+}
+
+void audio_report(FILE* f) {
+    if (!audio_open) return;
+
+    int count = SDL_AtomicGet(&latency_count);
+    if (!count) return;
+
+    // The mixed block still has to be played out of the device buffer, which adds up to its length
+    fprintf(f, "Audio: %d sounds, play to mix %.2f ms on average, %.2f ms max (buffer of %d samples, %.2f ms)\n",
+            count, SDL_AtomicGet(&latency_sum) / 1000.0 / count, SDL_AtomicGet(&latency_max) / 1000.0,
+            buffer_samples, buffer_samples * 1000.0 / frequency);
+
+    // Every round is reported on its own
+    SDL_AtomicSet(&latency_count, 0);
+    SDL_AtomicSet(&latency_sum, 0);
+    SDL_AtomicSet(&latency_max, 0);
+}
@@ -0,0 +1,179 @@
+#include "background.h"
+#include "compose.h"
+#include "perf.h"
+#include "rng.h"
+
+#include <stdlib.h> // malloc
+#include <string.h> // strcmp
+
+extern SDL_Renderer* ren;
+extern const int WIDTH, HEIGHT;
+
+// The generated background is a strip this wide, repeated, so its memory doesn't depend on the screen width
+#define PROCEDURAL_WIDTH 128
+#define PROCEDURAL_STARS 40
+
+// The background scrolls a pixel every this many ms
+#define SCROLL_MS 100
+
+static const char* bg_file = "res/bg.bmp";
+static _Bool bg_tiled = 0;
+static float bg_scale = 1;
+
+static SDL_Texture* tex;
+static SDL_Surface* pixels; // a copy for the compositor, only when it's on
+static _Bool opaque;
+static float tile_w, tile_h; // in logical units, the whole screen when stretched
+
+// The quads of a whole frame
+static SDL_Vertex* verts;
+static int* indices;
+static size_t max_quads;
+
+void background_configure(const char* file, _Bool tiled, float scale) {
+    bg_file = file;
+    bg_tiled = tiled || !strcmp(file, BACKGROUND_PROCEDURAL);
+    bg_scale = scale > 0 ? scale : 1;
+}
+
+// A strip of dark sky with stars, the stars wrap around its edges so that the strips join seamlessly
+static SDL_Surface* generate(int w, int h) {
+    SDL_Surface* surf = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (!surf) return NULL;
+
+    Uint32* pixels = surf->pixels;
+    const int pitch = surf->pitch / 4;
+
+    for (int y = 0; y < h; y++) {
+        Uint8 v = 10 + 30 * y / h;
+        for (int x = 0; x < w; x++)
+            pixels[y*pitch + x] = SDL_MapRGB(surf->format, v/2, v/2, v);
+    }
+
+    // Always the same sky
+    struct rng r;
+    rng_seed(&r, 1);
+
+    const int size = bg_scale > 1.5 ? 2 : 1;
+    for (int i = 0; i < PROCEDURAL_STARS; i++) {
+        int sx = rng_range(&r, w), sy = rng_range(&r, h);
+        Uint8 v = 120 + rng_range(&r, 136);
+        for (int dy = 0; dy < size; dy++)
+            for (int dx = 0; dx < size; dx++)
+                pixels[((sy+dy) % h)*pitch + (sx+dx) % w] = SDL_MapRGB(surf->format, v, v, v);
+    }
+
+    return surf;
+}
+
+SDL_Surface* background_load() {
+    if (!strcmp(bg_file, BACKGROUND_PROCEDURAL))
+        return generate((int)(PROCEDURAL_WIDTH * bg_scale), (int)(HEIGHT * bg_scale));
+
+    return SDL_LoadBMP(bg_file);
+}
+
+_Bool background_upload(SDL_Surface* surf) {
+    if (!surf) return 0;
+
+    tex = SDL_CreateTextureFromSurface(ren, surf);
+    opaque = surf->format->Amask == 0;
+
+    // The compositor only copies the opaque image, it blends the rest
+    if (compose_enabled() && (pixels = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_ARGB8888, 0)))
+        SDL_SetSurfaceBlendMode(pixels, opaque ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
+
+    // A tile is drawn 1:1, a stretched image covers the screen
+    if (bg_tiled) {
+        tile_w = surf->w / bg_scale;
+        tile_h = surf->h / bg_scale;
+    } else {
+        tile_w = WIDTH;
+        tile_h = HEIGHT;
+    }
+    SDL_FreeSurface(surf);
+    if (!tex) return 0;
+    perf.texture_uploads++;
+
+    // One more column and row for the ones that are partly scrolled in, the stretched image is split in two
+    max_quads = bg_tiled ? (size_t)(WIDTH / tile_w + 2) * (size_t)(HEIGHT / tile_h + 1) : 2;
+
+    verts = malloc(max_quads * 4 * sizeof(SDL_Vertex));
+    indices = malloc(max_quads * 6 * sizeof(int));
+    if (!verts || !indices) {
+        background_dealloc();
+        return 0;
+    }
+
+    for (size_t q = 0; q < max_quads; q++) {
+        int* i = &indices[q*6];
+        i[0] = q*4; i[1] = q*4+1; i[2] = q*4+2;
+        i[3] = q*4; i[4] = q*4+2; i[5] = q*4+3;
+    }
+
+    return 1;
+}
+
+void background_dealloc() {
+    SDL_DestroyTexture(tex);
+    SDL_FreeSurface(pixels);
+    free(verts);
+    free(indices);
+    tex = NULL;
+    pixels = NULL;
+    verts = NULL;
+    indices = NULL;
+    max_quads = 0;
+}
+
+_Bool background_opaque() {
+    return tex && opaque;
+}
+
+static SDL_Vertex* quad(SDL_Vertex* v, float x0, float y0, float x1, float y1, float u0, float u1, float v1) {
+    const SDL_Color white = {255, 255, 255, 255};
+    v[0] = (SDL_Vertex){{x0, y0}, white, {u0, 0 }};
+    v[1] = (SDL_Vertex){{x1, y0}, white, {u1, 0 }};
+    v[2] = (SDL_Vertex){{x1, y1}, white, {u1, v1}};
+    v[3] = (SDL_Vertex){{x0, y1}, white, {u0, v1}};
+    return v + 4;
+}
+
+void background_draw(Uint32 time) {
+    if (!tex) return;
+
+    SDL_Vertex* v = verts;
+
+    if (!bg_tiled) {
+        // The texture can't wrap around by itself, so the seam splits it into two quads:
+        // the start of the image right of the offset and its end left of it
+        float off = (time / SCROLL_MS) % WIDTH;
+        float seam = 1 - off / WIDTH;
+        v = quad(v, off, 0, WIDTH, HEIGHT, 0, seam, 1);
+        v = quad(v, 0, 0, off, HEIGHT, seam, 1, 1);
+    } else {
+        // Whole tiles, starting with the one that is partly scrolled in
+        Uint32 period = tile_w >= 1 ? (Uint32)(tile_w + 0.5f) : 1;
+        float off = (float)((time / SCROLL_MS) % period);
+        for (float y = 0; y < HEIGHT && (size_t)(v - verts) < max_quads*4; y += tile_h)
+            for (float x = off - tile_w; x < WIDTH && (size_t)(v - verts) < max_quads*4; x += tile_w)
+                v = quad(v, x, y, x + tile_w, y + tile_h, 0, 1, 1);
+    }
+
+    size_t quads = (v - verts) / 4;
+
+    // A composited frame blits the same quads from the pixels
+    if (compose_active() && pixels) {
+        const SDL_Color white = {255, 255, 255, 255};
+        for (const SDL_Vertex* q = verts; q < v; q += 4) {
+            int x0 = (int)(q[0].tex_coord.x * pixels->w + 0.5f), x1 = (int)(q[1].tex_coord.x * pixels->w + 0.5f);
+            compose_blit(pixels, &(SDL_Rect){x0, 0, x1 - x0, pixels->h},
+                         (SDL_FRect){q[0].position.x, q[0].position.y,
+                                     q[2].position.x - q[0].position.x, q[2].position.y - q[0].position.y}, white);
+        }
+        return;
+    }
+
+    SDL_RenderGeometry(ren, tex, verts, quads*4, indices, quads*6);
+    perf.draw_calls++;
+}
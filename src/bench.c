@@ -0,0 +1,811 @@
+#include "bench.h"
+#include "alias.h"
+#include "background.h"
+#include "compose.h"
+#include "dict.h"
+#include "game.h"
+#include "perf.h"
+#include "rng.h"
+#include "sim.h"
+#include "stats.h"
+#include "text.h"
+#include "utf8.h"
+#include "wordpool.h"
+
+#include <ctype.h> // isalpha, tolower
+#include <stdio.h> // printf
+#include <stdlib.h> // rand, calloc, strtod
+#include <string.h> // strcmp, strlen, memset
+
+#include <SDL.h>
+
+static double seconds_since(Uint64 start) {
+    return (SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+}
+
+// The linear probe that dict_pick used before the word pool, kept for comparison.
+// It marks the word as used, which the old code forgot to do
+static size_t probe_pick(_Bool* used, size_t size) {
+    size_t index = rand() % size;
+
+    for (size_t count = 0; used[index]; count++) {
+        if (count >= size)
+            return index;
+
+        index++;
+        index %= size;
+    }
+
+    used[index] = 1;
+    return index;
+}
+
+// Keeps `live` words picked at all times, every iteration releases the oldest one and picks another
+static int bench_pick(int argc, char* argv[]) {
+    (void)argc; (void)argv;
+
+    const size_t sizes[] = {10000, 100000, 1000000, 4000000};
+    const size_t iterations = 1000000;
+
+    printf("%10s %10s %14s %14s\n", "dict size", "picked", "probe ns/pick", "pool ns/pick");
+
+    for (size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+        const size_t size = sizes[s];
+        // The stream's 16 words, then a heavily used dictionary where the probe runs into clusters
+        const size_t lives[] = {16, size/2, size*9/10};
+
+        for (size_t l = 0; l < 3; l++) {
+            const size_t live = lives[l];
+
+            size_t* ring = malloc(live * sizeof(size_t));
+            _Bool* used = calloc(size, sizeof(_Bool));
+            struct wordpool pool;
+            if (!ring || !used || !wordpool_init(&pool, size)) {
+                fprintf(stderr, "Out of memory\n");
+                return 1;
+            }
+
+            // The old probe
+            srand(1);
+            for (size_t i = 0; i < live; i++)
+                ring[i] = probe_pick(used, size);
+
+            Uint64 start = SDL_GetPerformanceCounter();
+            for (size_t i = 0; i < iterations; i++) {
+                used[ring[i % live]] = 0;
+                ring[i % live] = probe_pick(used, size);
+            }
+            double probe = seconds_since(start);
+
+            // The word pool
+            struct rng r;
+            rng_seed(&r, 1);
+            for (size_t i = 0; i < live; i++)
+                ring[i] = wordpool_pick(&pool, &r);
+
+            start = SDL_GetPerformanceCounter();
+            for (size_t i = 0; i < iterations; i++) {
+                wordpool_release(&pool, ring[i % live]);
+                ring[i % live] = wordpool_pick(&pool, &r);
+            }
+            double pooled = seconds_since(start);
+
+            printf("%10zu %10zu %14.1f %14.1f\n", size, live,
+                   probe * 1e9 / iterations, pooled * 1e9 / iterations);
+
+            wordpool_destroy(&pool);
+            free(used);
+            free(ring);
+        }
+    }
+
+    if (RAND_MAX < 4000000)
+        printf("Note: RAND_MAX is %d here, the probe can only start at that many words\n", RAND_MAX);
+
+    return 0;
+}
+
+// The loader that dict_load replaced: one strdup per word and a doubling pointer array
+static char** legacy_dict_load(FILE* f, size_t* size, size_t* bytes) {
+
+    *size = 0; 
+    *bytes = 0;
+
+    size_t cap = 1;
+    char** dict = malloc(cap * sizeof(char*));
+    if (!dict) return NULL;
+
+    char str[WORDLEN];    
+    while (fscanf(f, "%11s", str) != EOF) {
+
+        for (int c; (c = fgetc(f)) != EOF && !isspace(c); )
+        ;
+
+        _Bool scrap = 0;
+        for (char* c = str; *c; c++)
+            if (!isalpha((unsigned char)*c)) { 
+                scrap = 1; 
+                break; 
+            } else *c = tolower((unsigned char)*c);
+        
+        if (scrap)
+            continue;
+
+        if (*size >= cap) {
+            char** grown = realloc(dict, (cap*=2) * sizeof(char*));
+            if (!grown) break;
+            dict = grown;
+        }
+
+        size_t len = strlen(str) + 1;
+        if (!(dict[*size] = malloc(len))) break;
+        memcpy(dict[*size], str, len);
+
+        // Every allocation costs about 16 bytes of malloc bookkeeping on top
+        *bytes += len + 16;
+        (*size)++;
+    }
+
+    *bytes += cap * sizeof(char*);
+
+    return dict;
+}
+
+// The resident set size in kB, 0 where we can't tell
+static long resident_kb() {
+#ifdef __linux__
+    long pages = 0, resident = 0;
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+    fclose(f);
+    return resident * 4;
+#else
+    return 0;
+#endif
+}
+
+// Writes a word list of random words of 3 to 11 letters
+static _Bool generate_words(const char* filename, unsigned long count) {
+    FILE* f = fopen(filename, "w");
+    if (!f) return 0;
+
+    struct rng r;
+    rng_seed(&r, 1);
+    for (unsigned long i = 0; i < count; i++) {
+        for (uint64_t len = 3 + rng_range(&r, 9); len--; )
+            fputc('a' + (int)rng_range(&r, 26), f);
+        fputc('\n', f);
+    }
+
+    return fclose(f) == 0;
+}
+
+// Loads a word list with both loaders, a number instead of a file generates that many random words
+static int bench_dict(int argc, char* argv[]) {
+
+    const char* filename = argc > 0 ? argv[0] : "res/dict.txt";
+    const char* generated = NULL;
+
+    char* end;
+    unsigned long count = strtoul(filename, &end, 10);
+    if (*end == '\0' && count > 0) {
+        generated = filename = "dict_bench.tmp";
+        if (!generate_words(filename, count)) return 1;
+    }
+
+    // The new loader goes first, its single block is given back to the system on free
+    long before = resident_kb();
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    struct dict d;
+    if (!dict_load(&d, filename)) {
+        fprintf(stderr, "Failed to load %s\n", filename);
+        return 1;
+    }
+
+    double arena_time = seconds_since(start);
+    long arena_rss = resident_kb() - before;
+    size_t arena_bytes = d.size * (sizeof(uint32_t) + 1) + (d.len - (uint8_t*)d.arena);
+    size_t words = d.size;
+
+    // Compile it and load it back, the widths don't matter here
+    const uint8_t glyph_width[26] = {0};
+    uint16_t* width = calloc(d.size, sizeof(uint16_t));
+    d.width = width;
+    _Bool compiled = width && dict_save_bin(&d, "dict_bench.bin", filename, glyph_width);
+    d.width = NULL;
+    free(width);
+    dict_destroy(&d);
+
+    double bin_time = 0;
+    if (compiled) {
+        start = SDL_GetPerformanceCounter();
+        compiled = dict_load_bin(&d, "dict_bench.bin", filename, glyph_width);
+        bin_time = seconds_since(start);
+        dict_destroy(&d);
+        remove("dict_bench.bin");
+    }
+
+    before = resident_kb();
+    start = SDL_GetPerformanceCounter();
+
+    FILE* f = fopen(filename, "r");
+    if (!f) return 1;
+    size_t legacy_size, legacy_bytes;
+    char** legacy = legacy_dict_load(f, &legacy_size, &legacy_bytes);
+    fclose(f);
+
+    double legacy_time = seconds_since(start);
+    long legacy_rss = resident_kb() - before;
+
+    for (size_t i = 0; i < legacy_size; i++)
+        free(legacy[i]);
+    free(legacy);
+
+    if (generated)
+        remove(generated);
+
+    printf("%zu words (%zu with the old loader)\n", words, legacy_size);
+    printf("%-8s %10s %12s %12s\n", "loader", "ms", "heap kB", "RSS +kB");
+    printf("%-8s %10.2f %12zu %12ld\n", "strdup", legacy_time * 1e3, legacy_bytes / 1024, legacy_rss);
+    printf("%-8s %10.2f %12zu %12ld\n", "arena", arena_time * 1e3, arena_bytes / 1024, arena_rss);
+    if (compiled)
+        printf("%-8s %10.2f %12s %12s\n", "binary", bin_time * 1e3, "mapped", "-");
+
+    return 0;
+}
+
+// Picking by the cumulative weights, what a weighted pick costs without the alias table
+static size_t cumulative_pick(const double* cumulative, size_t size, struct rng* r) {
+    double x = rng_double(r) * cumulative[size-1];
+
+    size_t lo = 0, hi = size-1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cumulative[mid] > x) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
+
+// Builds alias tables over Zipf weights (like word frequencies) of growing sizes and picks from them,
+// alone and the way the game does, keeping 16 words out of the pool
+static int bench_alias(int argc, char* argv[]) {
+
+    unsigned long max_size = argc > 0 ? strtoul(argv[0], NULL, 10) : 10000000;
+    const size_t iterations = 4000000, live = 16;
+
+    printf("%10s %10s %10s %12s %14s %16s\n", "dict size", "build ms", "table kB", "alias ns", "in-game ns", "cumulative ns");
+
+    for (size_t size = 10; size <= max_size; size *= 10) {
+        float* weight = malloc(size * sizeof(float));
+        double* cumulative = malloc(size * sizeof(double));
+        size_t ring[16];
+        struct wordpool pool;
+        if (!weight || !cumulative || !wordpool_init(&pool, size)) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+
+        double sum = 0;
+        for (size_t i = 0; i < size; i++) {
+            weight[i] = 1.0f / (i+1);
+            cumulative[i] = sum += weight[i];
+        }
+
+        struct alias_table t;
+        Uint64 start = SDL_GetPerformanceCounter();
+        if (!alias_build(&t, weight, size)) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        double build = seconds_since(start);
+
+        struct rng r;
+        rng_seed(&r, 1);
+
+        // The sum keeps the compiler from dropping the picks
+        size_t check = 0;
+        start = SDL_GetPerformanceCounter();
+        for (size_t i = 0; i < iterations; i++)
+            check += alias_pick(&t, &r);
+        double alias = seconds_since(start);
+
+        // The stream's words stay out of the pool, a word that's out is picked again
+        for (size_t i = 0; i < live && i < size; i++)
+            ring[i] = wordpool_pick(&pool, &r);
+
+        start = SDL_GetPerformanceCounter();
+        for (size_t i = 0; size > live && i < iterations; i++) {
+            wordpool_release(&pool, ring[i % live]);
+
+            size_t word;
+            while (!wordpool_take(&pool, word = alias_pick(&t, &r)))
+            ;
+            ring[i % live] = word;
+        }
+        double in_game = seconds_since(start);
+
+        start = SDL_GetPerformanceCounter();
+        for (size_t i = 0; i < iterations; i++)
+            check += cumulative_pick(cumulative, size, &r);
+        double cumul = seconds_since(start);
+
+        if (size > live)
+            printf("%10zu %10.2f %10zu %12.1f %14.1f %16.1f\n", size, build * 1e3, size * 2 * sizeof(uint32_t) / 1024,
+                   alias * 1e9 / iterations, in_game * 1e9 / iterations, cumul * 1e9 / iterations);
+        else
+            printf("%10zu %10.2f %10zu %12.1f %14s %16.1f\n", size, build * 1e3, size * 2 * sizeof(uint32_t) / 1024,
+                   alias * 1e9 / iterations, "-", cumul * 1e9 / iterations);
+
+        if (check == 1) printf("\n");
+
+        alias_destroy(&t);
+        wordpool_destroy(&pool);
+        free(weight);
+        free(cumulative);
+    }
+
+    return 0;
+}
+
+// Indexes the bigrams of growing random dictionaries (or a given word list), then picks words
+// that have one of the 4 bigrams with the most words, like the adaptive picks do
+static int bench_bigram(int argc, char* argv[]) {
+
+    const size_t iterations = 4000000;
+    const unsigned long sizes[] = {10000, 100000, 1000000};
+    const size_t runs = argc > 0 ? 1 : sizeof(sizes)/sizeof(sizes[0]);
+
+    printf("%10s %10s %10s %10s %10s %10s\n", "words", "postings", "build ms", "index kB", "raw kB", "pick ns");
+
+    for (size_t run = 0; run < runs; run++) {
+        const char* filename = argc > 0 ? argv[0] : "dict_bench.tmp";
+        if (argc == 0 && !generate_words(filename, sizes[run])) return 1;
+
+        struct dict d;
+        _Bool loaded = dict_load(&d, filename);
+        if (argc == 0) remove(filename);
+        if (!loaded) {
+            fprintf(stderr, "Failed to load %s\n", filename);
+            return 1;
+        }
+
+        struct bigram_index idx;
+        Uint64 start = SDL_GetPerformanceCounter();
+        if (!bigram_index_build(&idx, &d)) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        double build = seconds_since(start);
+
+        size_t postings = 0;
+        for (size_t b = 0; b < BIGRAMS; b++)
+            postings += idx.count[b];
+        size_t blocks = idx.skip_start[BIGRAMS];
+
+        // The longest lists
+        uint16_t weak[4] = {0};
+        size_t weak_count = 0, weak_words = 0;
+        for (size_t b = 0; b < BIGRAMS; b++) {
+            if (idx.count[b] == 0) continue;
+
+            size_t i = weak_count < 4 ? weak_count++ : 4;
+            for (; i > 0 && idx.count[weak[i-1]] < idx.count[b]; i--)
+                if (i < 4) weak[i] = weak[i-1];
+            if (i < 4) weak[i] = b;
+        }
+        for (size_t i = 0; i < weak_count; i++)
+            weak_words += idx.count[weak[i]];
+
+        struct rng r;
+        rng_seed(&r, 1);
+
+        // Every picked word has to have its bigram
+        size_t wrong = 0, check = 0;
+        for (size_t i = 0; i < 10000 && weak_words; i++) {
+            size_t k = rng_range(&r, idx.count[weak[i % weak_count]]);
+            const char* word = dict_word(&d, bigram_index_get(&idx, weak[i % weak_count], k));
+            char bigram[3] = {'a' + weak[i % weak_count] / 26, 'a' + weak[i % weak_count] % 26, '\0'};
+            if (!strstr(word, bigram)) wrong++;
+        }
+
+        start = SDL_GetPerformanceCounter();
+        for (size_t i = 0; i < iterations && weak_words; i++) {
+            size_t k = rng_range(&r, weak_words), w = 0;
+            while (k >= idx.count[weak[w]])
+                k -= idx.count[weak[w++]];
+            check += bigram_index_get(&idx, weak[w], k);
+        }
+        double pick = seconds_since(start);
+
+        printf("%10zu %10zu %10.2f %10zu %10zu %10.1f\n", d.size, postings, build * 1e3,
+               (idx.size + blocks * 2 * sizeof(uint32_t) + sizeof(idx)) / 1024, postings * sizeof(uint32_t) / 1024,
+               pick * 1e9 / iterations);
+        if (wrong) printf("%zu picked words don't have their bigram\n", wrong);
+        if (check == 1) printf("\n");
+
+        bigram_index_destroy(&idx);
+        dict_destroy(&d);
+    }
+
+    return 0;
+}
+
+extern SDL_Renderer* ren;
+extern const int WIDTH, HEIGHT;
+
+// Queues glyphs of growing sets of codepoints into the word stream's atlas: a-z, the letters
+// of the Latin and Cyrillic word lists, and thousands of CJK ideographs, which are more
+// than an atlas holds. Only the queuing is timed, the batches are drawn in between
+static int bench_glyphs(int argc, char* argv[]) {
+    (void)argc;
+    (void)argv;
+
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+    if (SDL_Init(SDL_INIT_VIDEO)) {
+        fprintf(stderr, "SDL2 failed to initialize: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    SDL_Surface* target = SDL_CreateRGBSurfaceWithFormat(0, WIDTH, HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (!target || !(ren = SDL_CreateSoftwareRenderer(target)) || !font_init()) {
+        fprintf(stderr, "Failed to set up the text: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    const struct { const char* name; uint32_t first; size_t count; } sets[] = {
+        {"a-z", 'a', 26},
+        {"latin-1", 0xE0, 32},
+        {"cyrillic", 0x430, 48},
+        {"cjk 1000", 0x4E00, 1000},
+        {"cjk 4000", 0x4E00, 4000},
+    };
+    const size_t glyphs = 1 << 21, batch = 256;
+
+    printf("%10s %10s %10s %10s %10s\n", "set", "distinct", "queue ns", "misses", "evicted");
+
+    for (size_t set = 0; set < sizeof(sets)/sizeof(sets[0]); set++) {
+        // A pass over the set fills the atlas first
+        for (size_t i = 0; i < sets[set].count; i++) {
+            render_char_cached(0, sets[set].first + i, 0, 0, 0.5);
+            if (i % batch == batch-1) render_cached_flush();
+        }
+        render_cached_flush();
+        memset(&perf, 0, sizeof(perf));
+
+        double queued = 0;
+        for (size_t i = 0; i < glyphs; ) {
+            Uint64 start = SDL_GetPerformanceCounter();
+            for (size_t end = i + batch; i < end; i++)
+                render_char_cached(0, sets[set].first + i % sets[set].count, (float)(i % 64) * 10, 0, 0.5);
+            queued += seconds_since(start);
+            render_cached_flush();
+        }
+
+        printf("%10s %10zu %10.1f %10u %10u\n", sets[set].name, sets[set].count, queued * 1e9 / glyphs,
+               perf.glyph_misses, perf.glyph_evictions);
+    }
+
+    font_dealloc();
+    SDL_DestroyRenderer(ren);
+    SDL_FreeSurface(target);
+    SDL_Quit();
+    return 0;
+}
+
+// The next key for the rightmost visible word of the snapshot, returns how many letters to erase first
+static size_t snapshot_key(const struct game_snapshot* snap, char key[UTF8_MAX+1]) {
+    memset(key, 0, UTF8_MAX+1);
+
+    const char* target = NULL;
+    float target_x = 0;
+    for (size_t i = 0; i < snap->words; i++)
+        if (snap->x[i] >= 0 && (!target || snap->x[i] > target_x)) {
+            target = snap->word[i];
+            target_x = snap->x[i];
+        }
+    if (!target) return 0;
+
+    size_t len = strlen(snap->input), erase = 0;
+    if (strncmp(snap->input, target, len)) {
+        erase = utf8_length(snap->input);
+        len = 0;
+    }
+
+    const char* next = target + len;
+    if (*next) utf8_encode(utf8_next(&next), key);
+    return erase;
+}
+
+// The simulation against a renderer that stalls for the given time every frame on top of drawing,
+// like a blocking present would. The ticks run in the frame loop first, like they did before
+// the simulation thread, then on the simulation thread, and it prints how late the ticks ran
+static int bench_sim(int argc, char* argv[]) {
+    const double seconds = argc > 0 ? strtod(argv[0], NULL) : 3;
+    const Uint32 stalls[] = {0, 16, 50, 100};
+    const Uint32 key_ms = 60000 / 300;
+
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+    if (SDL_Init(SDL_INIT_VIDEO)) {
+        fprintf(stderr, "SDL2 failed to initialize: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    struct game g;
+    SDL_Surface* target = SDL_CreateRGBSurfaceWithFormat(0, WIDTH, HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (!target || !(ren = SDL_CreateSoftwareRenderer(target)) || !font_init() || !game_init() || !game_create(&g)) {
+        fprintf(stderr, "Failed to set up the game: %s\n", SDL_GetError());
+        return 1;
+    }
+    SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_BLEND);
+    g.visible = 1;
+
+    const Uint64 freq = SDL_GetPerformanceFrequency(), tick = freq * TICK_MS / 1000;
+    struct game_snapshot snap = {0};
+
+    printf("%8s %8s %8s %8s %12s %12s %12s\n", "stall ms", "ticks", "frames", "thread", "late p50 ms", "p99 ms", "max ms");
+
+    for (size_t i = 0; i < sizeof(stalls)/sizeof(stalls[0]); i++)
+        for (int threaded = 0; threaded < 2; threaded++) {
+            struct sim sim;
+            struct histogram late;
+            histogram_reset(&late);
+            const struct game_snapshot* drawn = &snap;
+
+            unsigned round = 1;
+            if (threaded) {
+                if (!sim_open(&sim, &g, NULL, NULL) || !sim_play(&sim, 1)) return 1;
+            } else {
+                game_set_seed(&g, 1);
+                game_start(&g);
+            }
+
+            Uint64 start = SDL_GetPerformanceCounter(), next = start, next_key = start;
+            unsigned frames = 0;
+            while (SDL_GetPerformanceCounter() - start < seconds * freq) {
+                Uint64 now = SDL_GetPerformanceCounter();
+
+                if (threaded) {
+                    const struct sim_frame* f = sim_frame(&sim);
+                    if (f->round != round) continue;
+                    if (f->lost && sim_play(&sim, 1)) round++;
+                    late = f->late;
+                    drawn = &f->game;
+                } else {
+                    if (now > next + 25 * tick) next = now - 25 * tick;
+                    for (; next <= now; next += tick) {
+                        histogram_add(&late, (now - next) * 1000000 / freq);
+                        if (!game_update(&g)) game_start(&g);
+                    }
+                    game_snapshot(&g, &snap);
+                }
+
+                // The typist only sees the frames, so it types at most one key a frame
+                if (now >= next_key) {
+                    next_key += key_ms * freq / 1000;
+                    if (next_key < now) next_key = now;
+
+                    char key[UTF8_MAX+1];
+                    size_t erase = snapshot_key(drawn, key);
+                    if (threaded) {
+                        if (erase) sim_delete(&sim, erase);
+                        if (key[0]) sim_text(&sim, key);
+                    } else {
+                        if (erase) game_input_delete(&g, erase);
+                        if (key[0]) game_textinput(&g, key);
+                    }
+                }
+
+                SDL_SetRenderDrawColor(ren, 0, 0, 0, 255);
+                SDL_RenderClear(ren);
+                game_draw(drawn, 1.0);
+                SDL_RenderPresent(ren);
+                SDL_Delay(stalls[i]);
+                frames++;
+            }
+
+            if (threaded) sim_close(&sim);
+
+            printf("%8u %8llu %8u %8s %12.2f %12.2f %12.2f\n", stalls[i], (unsigned long long)late.count, frames,
+                   threaded ? "yes" : "no", histogram_percentile(&late, 0.5) / 1000.0,
+                   histogram_percentile(&late, 0.99) / 1000.0, late.max / 1000.0);
+        }
+
+    game_snapshot_destroy(&snap);
+    game_destroy(&g);
+    game_dealloc();
+    font_dealloc();
+    SDL_DestroyRenderer(ren);
+    SDL_FreeSurface(target);
+    SDL_Quit();
+    return 0;
+}
+
+// A surface of random pixels, transparent, half transparent and opaque like the glyphs and the particles are
+static SDL_Surface* random_surface(int w, int h, _Bool opaque) {
+    SDL_Surface* surf = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (!surf) return NULL;
+
+    struct rng r;
+    rng_seed(&r, 1);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            Uint32 a = opaque ? 255 : (Uint32[]){0, 0, 128, 255}[rng_range(&r, 4)];
+            ((Uint32*)surf->pixels)[y * surf->pitch/4 + x] = a << 24 | (rng_next(&r) & 0xFFFFFF);
+        }
+
+    SDL_SetSurfaceBlendMode(surf, opaque ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
+    return surf;
+}
+
+// A frame of the game drawn by SDL's software renderer, then composited with each of the kernels,
+// and the kernels alone over the whole frame against the renderer doing the same
+static int bench_compose(int argc, char* argv[]) {
+    const char* background = argc > 0 ? argv[0] : "res/bg.bmp";
+    const int frames = 300, repeats = 200;
+
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+    if (SDL_Init(SDL_INIT_VIDEO)) {
+        fprintf(stderr, "SDL2 failed to initialize: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    SDL_Surface* target = SDL_CreateRGBSurfaceWithFormat(0, WIDTH, HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (!target || !(ren = SDL_CreateSoftwareRenderer(target))) {
+        fprintf(stderr, "Failed to create the renderer: %s\n", SDL_GetError());
+        return 1;
+    }
+    SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_BLEND);
+
+    // The atlas and the background keep their pixels for the compositor, the renderer draws them the same
+    struct game g;
+    compose_init(COMPOSE_ON);
+    background_configure(background, 0, 1);
+    if (!font_init() || !game_init() || !game_create(&g) || !background_upload(background_load())) {
+        fprintf(stderr, "Failed to set up the game: %s\n", SDL_GetError());
+        return 1;
+    }
+    g.visible = 1;
+
+    // A round a few seconds in, with a full stream and some particles flying
+    struct game_snapshot snap = {0};
+    game_set_seed(&g, 1);
+    game_start(&g);
+    for (unsigned tick = 0; tick < 6000 && (tick < 1000 || snap.particles == 0); tick++) {
+        if (!game_update(&g)) game_start(&g);
+        game_snapshot(&g, &snap);
+
+        if (tick % 20) continue;
+        char key[UTF8_MAX+1];
+        size_t erase = snapshot_key(&snap, key);
+        if (erase) game_input_delete(&g, erase);
+        if (key[0]) game_textinput(&g, key);
+    }
+
+    size_t letters = 0;
+    for (size_t i = 0; i < snap.words; i++)
+        letters += utf8_length(snap.word[i]);
+    printf("%zu words, %zu letters, %zu particles\n\n", snap.words, letters, snap.particles);
+
+    // The scalar frame, to check that the SIMD kernels composite the same pixels
+    Uint32* reference = malloc(target->pitch * target->h);
+    if (!reference) return 1;
+
+    printf("%10s %12s %12s %12s %12s\n", "path", "ms/frame", "draw calls", "cpu blits", "same pixels");
+    for (int path = -1; path <= COMPOSE_AVX2; path++) {
+        if (path >= 0 && !compose_set_isa(path)) continue;
+
+        memset(&perf, 0, sizeof(perf));
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int f = 0; f < frames; f++) {
+            _Bool composing = path >= 0 && compose_begin(!background_opaque());
+            if (!composing && !background_opaque()) {
+                SDL_SetRenderDrawColor(ren, 0, 0, 0, 255);
+                SDL_RenderClear(ren);
+                perf.draw_calls++;
+            }
+            background_draw(0);
+            game_draw(&snap, 1.0);
+            compose_end();
+            SDL_RenderPresent(ren);
+        }
+        double ms = seconds_since(start) * 1000 / frames;
+
+        const char* same = "";
+        if (path == COMPOSE_SCALAR)
+            memcpy(reference, target->pixels, target->pitch * target->h);
+        else if (path > COMPOSE_SCALAR)
+            same = memcmp(reference, target->pixels, target->pitch * target->h) ? "no" : "yes";
+
+        printf("%10s %12.3f %12.1f %12.1f %12s\n", path < 0 ? "renderer" : compose_isa_name(path), ms,
+               (double)perf.draw_calls / frames, (double)perf.composed / frames, same);
+    }
+
+    // The kernels on their own: a translucent fill, a 1:1 blend of a tinted surface
+    // and an opaque surface of half the size stretched, all over the whole frame
+    SDL_Surface* glyphs = random_surface(WIDTH, HEIGHT, 0);
+    SDL_Surface* image = random_surface(WIDTH/2, HEIGHT/2, 1);
+    SDL_Texture* glyphs_tex = glyphs ? SDL_CreateTextureFromSurface(ren, glyphs) : NULL;
+    SDL_Texture* image_tex = image ? SDL_CreateTextureFromSurface(ren, image) : NULL;
+    if (!glyphs_tex || !image_tex) {
+        fprintf(stderr, "Failed to create the surfaces: %s\n", SDL_GetError());
+        return 1;
+    }
+    SDL_SetTextureBlendMode(glyphs_tex, SDL_BLENDMODE_BLEND);
+    SDL_SetTextureColorMod(glyphs_tex, 100, 200, 255);
+    SDL_SetTextureBlendMode(image_tex, SDL_BLENDMODE_NONE);
+
+    const SDL_FRect all = {0, 0, WIDTH, HEIGHT};
+    const SDL_Color fill = {0, 0, 0, 100}, tint = {100, 200, 255, 255}, white = {255, 255, 255, 255};
+    const double pixels = (double)WIDTH * HEIGHT * repeats;
+
+    printf("\n%10s %12s %12s %12s\n", "path", "fill ns/px", "blend ns/px", "scale ns/px");
+    for (int path = -1; path <= COMPOSE_AVX2; path++) {
+        if (path >= 0 && !compose_set_isa(path)) continue;
+        if (path >= 0 && !compose_begin(1)) return 1;
+
+        double ns[3];
+        for (int op = 0; op < 3; op++) {
+            Uint64 start = SDL_GetPerformanceCounter();
+            for (int i = 0; i < repeats; i++)
+                if (op == 0)
+                    compose_fill(all, fill);
+                else if (path >= 0)
+                    compose_blit(op == 1 ? glyphs : image, NULL, all, op == 1 ? tint : white);
+                else
+                    SDL_RenderCopyF(ren, op == 1 ? glyphs_tex : image_tex, NULL, &all);
+
+            // The renderer may only queue the draw calls
+            if (path < 0) SDL_RenderFlush(ren);
+            ns[op] = seconds_since(start) * 1e9 / pixels;
+        }
+
+        compose_end();
+        printf("%10s %12.3f %12.3f %12.3f\n", path < 0 ? "renderer" : compose_isa_name(path), ns[0], ns[1], ns[2]);
+    }
+
+    SDL_DestroyTexture(glyphs_tex);
+    SDL_DestroyTexture(image_tex);
+    SDL_FreeSurface(glyphs);
+    SDL_FreeSurface(image);
+    free(reference);
+    game_snapshot_destroy(&snap);
+    game_destroy(&g);
+    game_dealloc();
+    background_dealloc();
+    compose_dealloc();
+    font_dealloc();
+    SDL_DestroyRenderer(ren);
+    SDL_FreeSurface(target);
+    SDL_Quit();
+    return 0;
+}
+
+static const struct {
+    const char* name;
+    int (*run)(int argc, char* argv[]);
+} benchmarks[] = {
+    {"pick", bench_pick},
+    {"dict", bench_dict},
+    {"alias", bench_alias},
+    {"bigram", bench_bigram},
+    {"glyphs", bench_glyphs},
+    {"sim", bench_sim},
+    {"compose", bench_compose},
+};
+
+int bench_main(int argc, char* argv[]) {
+
+    for (size_t i = 0; argc > 0 && i < sizeof(benchmarks)/sizeof(benchmarks[0]); i++)
+        if (!strcmp(argv[0], benchmarks[i].name))
+            return benchmarks[i].run(argc-1, argv+1);
+
+    fprintf(stderr, "Usage: --bench <name> [args], where name is one of:");
+    for (size_t i = 0; i < sizeof(benchmarks)/sizeof(benchmarks[0]); i++)
+        fprintf(stderr, " %s", benchmarks[i].name);
+    fprintf(stderr, "\n");
+
+    return 1;
+}
@@ -0,0 +1,426 @@
+#include "compose.h"
+#include "perf.h"
+#include "text.h"
+
+#include <math.h> // floorf
+#include <stdio.h> // fprintf
+#include <stdlib.h> // realloc, free
+#include <string.h> // memcpy
+
+// The AVX2 kernels are compiled for AVX2 on their own and only used when the CPU has it,
+// the SSE2 ones whenever the target has SSE2 (every x86-64 does)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_AVX2
+#define AVX2 __attribute__((target("avx2")))
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+extern SDL_Renderer* ren;
+extern const int WIDTH, HEIGHT;
+
+// The kernels work on rows of ARGB8888 pixels. The frame is opaque, they always write an alpha of 255
+struct kernels {
+    // Blends the color over the row
+    void (*fill)(Uint32* dst, size_t n, Uint32 col);
+    // Blends the source over the row by its alpha, modulated by the color
+    void (*blend)(Uint32* dst, const Uint32* src, size_t n, Uint32 mod);
+    // Copies the source pixel u >> 16 for every pixel, u advancing by du (16.16 fixed point)
+    void (*scale)(Uint32* dst, const Uint32* src, size_t n, Uint32 u, Uint32 du);
+};
+
+// x / 255 rounded, exact for the products of two bytes
+static inline Uint32 div255(Uint32 x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+static void fill_opaque(Uint32* dst, size_t n, Uint32 col) {
+    for (size_t i = 0; i < n; i++)
+        dst[i] = col;
+}
+
+static void fill_scalar(Uint32* dst, size_t n, Uint32 col) {
+    const Uint32 a = col >> 24, ia = 255 - a;
+    const Uint32 r = (col >> 16 & 0xFF) * a, g = (col >> 8 & 0xFF) * a, b = (col & 0xFF) * a;
+
+    for (size_t i = 0; i < n; i++) {
+        Uint32 d = dst[i];
+        dst[i] = 0xFF000000 | div255(r + (d >> 16 & 0xFF) * ia) << 16
+                            | div255(g + (d >> 8 & 0xFF) * ia) << 8
+                            | div255(b + (d & 0xFF) * ia);
+    }
+}
+
+static void blend_scalar(Uint32* dst, const Uint32* src, size_t n, Uint32 mod) {
+    const Uint32 ma = mod >> 24, mr = mod >> 16 & 0xFF, mg = mod >> 8 & 0xFF, mb = mod & 0xFF;
+
+    for (size_t i = 0; i < n; i++) {
+        Uint32 s = src[i], a = div255((s >> 24) * ma);
+        if (a == 0) continue;
+
+        Uint32 r = div255((s >> 16 & 0xFF) * mr), g = div255((s >> 8 & 0xFF) * mg), b = div255((s & 0xFF) * mb);
+        Uint32 d = dst[i], ia = 255 - a;
+        dst[i] = 0xFF000000 | div255(r * a + (d >> 16 & 0xFF) * ia) << 16
+                            | div255(g * a + (d >> 8 & 0xFF) * ia) << 8
+                            | div255(b * a + (d & 0xFF) * ia);
+    }
+}
+
+static void scale_scalar(Uint32* dst, const Uint32* src, size_t n, Uint32 u, Uint32 du) {
+    for (size_t i = 0; i < n; i++, u += du)
+        dst[i] = src[u >> 16];
+}
+
+// The SIMD kernels widen the channels to 16 bits and do exactly the same math as the scalar ones,
+// so all of them composite the same frame to the bit
+#ifdef __SSE2__
+static inline __m128i div255_sse2(__m128i x) {
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// Two widened pixels
+static inline __m128i blend2_sse2(__m128i s, __m128i d, __m128i mod) {
+    s = div255_sse2(_mm_mullo_epi16(s, mod));
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    __m128i ia = _mm_sub_epi16(_mm_set1_epi16(255), a);
+    return div255_sse2(_mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, ia)));
+}
+
+static void fill_sse2(Uint32* dst, size_t n, Uint32 col) {
+    const __m128i zero = _mm_setzero_si128(), opaque = _mm_set1_epi32((int)0xFF000000);
+    const __m128i c = _mm_mullo_epi16(_mm_unpacklo_epi8(_mm_set1_epi32((int)col), zero), _mm_set1_epi16(col >> 24));
+    const __m128i ia = _mm_set1_epi16(255 - (col >> 24));
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i lo = div255_sse2(_mm_add_epi16(c, _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), ia)));
+        __m128i hi = div255_sse2(_mm_add_epi16(c, _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), ia)));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_packus_epi16(lo, hi), opaque));
+    }
+    fill_scalar(dst + i, n - i, col);
+}
+
+static void blend_sse2(Uint32* dst, const Uint32* src, size_t n, Uint32 mod) {
+    const __m128i zero = _mm_setzero_si128(), opaque = _mm_set1_epi32((int)0xFF000000);
+    const __m128i m = _mm_unpacklo_epi8(_mm_set1_epi32((int)mod), zero);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+
+        // Most of a glyph's cell is transparent
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, opaque), zero)) == 0xFFFF)
+            continue;
+
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i lo = blend2_sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), m);
+        __m128i hi = blend2_sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), m);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_packus_epi16(lo, hi), opaque));
+    }
+    blend_scalar(dst + i, src + i, n - i, mod);
+}
+#endif
+
+// The same as SSE2, eight pixels at a time. The unpacking and the packing both work within
+// the 128 bit lanes, so the pixels come out in the order they went in
+#ifdef HAVE_AVX2
+AVX2 static inline __m256i div255_avx2(__m256i x) {
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+AVX2 static inline __m256i blend4_avx2(__m256i s, __m256i d, __m256i mod) {
+    s = div255_avx2(_mm256_mullo_epi16(s, mod));
+    __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    __m256i ia = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+    return div255_avx2(_mm256_add_epi16(_mm256_mullo_epi16(s, a), _mm256_mullo_epi16(d, ia)));
+}
+
+AVX2 static void fill_avx2(Uint32* dst, size_t n, Uint32 col) {
+    const __m256i zero = _mm256_setzero_si256(), opaque = _mm256_set1_epi32((int)0xFF000000);
+    const __m256i c = _mm256_mullo_epi16(_mm256_unpacklo_epi8(_mm256_set1_epi32((int)col), zero),
+                                         _mm256_set1_epi16(col >> 24));
+    const __m256i ia = _mm256_set1_epi16(255 - (col >> 24));
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i lo = div255_avx2(_mm256_add_epi16(c, _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), ia)));
+        __m256i hi = div255_avx2(_mm256_add_epi16(c, _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), ia)));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_or_si256(_mm256_packus_epi16(lo, hi), opaque));
+    }
+    fill_scalar(dst + i, n - i, col);
+}
+
+AVX2 static void blend_avx2(Uint32* dst, const Uint32* src, size_t n, Uint32 mod) {
+    const __m256i zero = _mm256_setzero_si256(), opaque = _mm256_set1_epi32((int)0xFF000000);
+    const __m256i m = _mm256_unpacklo_epi8(_mm256_set1_epi32((int)mod), zero);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_and_si256(s, opaque), zero)) == -1)
+            continue;
+
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i lo = blend4_avx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero), m);
+        __m256i hi = blend4_avx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero), m);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_or_si256(_mm256_packus_epi16(lo, hi), opaque));
+    }
+    blend_scalar(dst + i, src + i, n - i, mod);
+}
+
+// The eight source pixels are gathered in one instruction
+AVX2 static void scale_avx2(Uint32* dst, const Uint32* src, size_t n, Uint32 u, Uint32 du) {
+    __m256i uv = _mm256_add_epi32(_mm256_set1_epi32((int)u),
+                                  _mm256_mullo_epi32(_mm256_set1_epi32((int)du), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+    const __m256i step = _mm256_set1_epi32((int)(du * 8));
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_i32gather_epi32((const int*)src, _mm256_srli_epi32(uv, 16), 4));
+        uv = _mm256_add_epi32(uv, step);
+    }
+    scale_scalar(dst + i, src, n - i, u + (Uint32)i * du, du);
+}
+#endif
+
+static const struct kernels kernels_scalar = {fill_scalar, blend_scalar, scale_scalar};
+#ifdef __SSE2__
+// SSE2 can't gather, so the scaling stays scalar
+static const struct kernels kernels_sse2 = {fill_sse2, blend_sse2, scale_scalar};
+#endif
+#ifdef HAVE_AVX2
+static const struct kernels kernels_avx2 = {fill_avx2, blend_avx2, scale_avx2};
+#endif
+
+static _Bool enabled = 0, active = 0;
+static enum compose_isa isa = COMPOSE_SCALAR;
+static const struct kernels* kernels = &kernels_scalar;
+
+// The frame is the streaming texture, locked between compose_begin and compose_end
+static SDL_Texture* frame_tex;
+static int frame_w, frame_h;
+static Uint32* frame;
+static int frame_pitch; // in pixels
+static float frame_scale;
+
+// A scaled row on its way to being blended
+static Uint32* row;
+
+void compose_init(enum compose_mode mode) {
+    SDL_RendererInfo info;
+    enabled = mode == COMPOSE_ON ||
+              (mode == COMPOSE_AUTO && !SDL_GetRendererInfo(ren, &info) && !(info.flags & SDL_RENDERER_ACCELERATED));
+
+    if (!compose_set_isa(COMPOSE_AVX2) && !compose_set_isa(COMPOSE_SSE2))
+        compose_set_isa(COMPOSE_SCALAR);
+}
+
+void compose_dealloc() {
+    if (active) SDL_UnlockTexture(frame_tex);
+    SDL_DestroyTexture(frame_tex);
+    free(row);
+
+    frame_tex = NULL;
+    row = NULL;
+    frame = NULL;
+    frame_w = frame_h = 0;
+    active = 0;
+}
+
+_Bool compose_enabled() {
+    return enabled;
+}
+
+_Bool compose_set_isa(enum compose_isa which) {
+    const struct kernels* k = NULL;
+
+    switch (which) {
+        case COMPOSE_SCALAR :
+            k = &kernels_scalar;
+        break;
+#ifdef __SSE2__
+        case COMPOSE_SSE2 :
+            if (SDL_HasSSE2()) k = &kernels_sse2;
+        break;
+#endif
+#ifdef HAVE_AVX2
+        case COMPOSE_AVX2 :
+            if (SDL_HasAVX2()) k = &kernels_avx2;
+        break;
+#endif
+        default :
+        break;
+    }
+
+    if (!k) return 0;
+
+    kernels = k;
+    isa = which;
+    return 1;
+}
+
+enum compose_isa compose_isa() {
+    return isa;
+}
+
+const char* compose_isa_name(enum compose_isa which) {
+    static const char* names[] = {"scalar", "SSE2", "AVX2"};
+    return names[which];
+}
+
+_Bool compose_begin(_Bool clear) {
+    if (!enabled) return 0;
+
+    // A pixel of the frame for every pixel of the window, like the text has
+    float scale = text_pixel_scale();
+    int w = (int)(WIDTH * scale + 0.5f), h = (int)(HEIGHT * scale + 0.5f);
+
+    if (!frame_tex || w != frame_w || h != frame_h) {
+        compose_dealloc();
+
+        frame_tex = SDL_CreateTexture(ren, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, w, h);
+        row = malloc(w * sizeof(Uint32));
+        if (!frame_tex || !row) {
+            fprintf(stderr, "Failed to create the composited frame, drawing with the renderer: %s\n", SDL_GetError());
+            compose_dealloc();
+            enabled = 0;
+            return 0;
+        }
+
+        // Every pixel is drawn, the texture replaces whatever is under it
+        SDL_SetTextureBlendMode(frame_tex, SDL_BLENDMODE_NONE);
+        perf.texture_uploads++;
+
+        frame_w = w;
+        frame_h = h;
+    }
+    frame_scale = scale;
+
+    void* pixels;
+    int pitch;
+    if (SDL_LockTexture(frame_tex, NULL, &pixels, &pitch))
+        return 0;
+
+    frame = pixels;
+    frame_pitch = pitch / 4;
+    active = 1;
+
+    if (clear)
+        for (int y = 0; y < frame_h; y++)
+            fill_opaque(frame + y * frame_pitch, frame_w, 0xFF000000);
+
+    return 1;
+}
+
+void compose_end() {
+    if (!active) return;
+
+    active = 0;
+    SDL_UnlockTexture(frame_tex);
+
+    SDL_RenderCopyF(ren, frame_tex, NULL, &(SDL_FRect){0, 0, WIDTH, HEIGHT});
+    perf.draw_calls++;
+}
+
+_Bool compose_active() {
+    return active;
+}
+
+static int to_pixels(float v) {
+    return (int)floorf(v * frame_scale + 0.5f);
+}
+
+// The rectangle in the pixels of the frame, and the part of it inside the frame. False if that's empty.
+// The edges are rounded on their own, so rectangles that touch in logical units touch in pixels too
+static _Bool frame_clip(SDL_FRect rect, SDL_Rect* whole, SDL_Rect* clipped) {
+    int x0 = to_pixels(rect.x), y0 = to_pixels(rect.y);
+    int x1 = to_pixels(rect.x + rect.w), y1 = to_pixels(rect.y + rect.h);
+    *whole = (SDL_Rect){x0, y0, x1 - x0, y1 - y0};
+
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > frame_w) x1 = frame_w;
+    if (y1 > frame_h) y1 = frame_h;
+    *clipped = (SDL_Rect){x0, y0, x1 - x0, y1 - y0};
+
+    return x1 > x0 && y1 > y0;
+}
+
+static Uint32 pack(SDL_Color col) {
+    return (Uint32)col.a << 24 | (Uint32)col.r << 16 | (Uint32)col.g << 8 | col.b;
+}
+
+void compose_fill(SDL_FRect rect, SDL_Color col) {
+    if (!active) {
+        SDL_SetRenderDrawColor(ren, col.r, col.g, col.b, col.a);
+        SDL_RenderFillRectF(ren, &rect);
+        perf.draw_calls++;
+        return;
+    }
+
+    SDL_Rect whole, d;
+    if (col.a == 0 || !frame_clip(rect, &whole, &d))
+        return;
+
+    const Uint32 c = pack(col);
+    for (int y = d.y; y < d.y + d.h; y++) {
+        Uint32* dst = frame + y * frame_pitch + d.x;
+        if (col.a == 255) fill_opaque(dst, d.w, c);
+        else kernels->fill(dst, d.w, c);
+    }
+
+    perf.composed++;
+}
+
+void compose_blit(SDL_Surface* src, const SDL_Rect* src_rect, SDL_FRect rect, SDL_Color col) {
+    if (!active || !src || src->format->format != SDL_PIXELFORMAT_ARGB8888)
+        return;
+
+    SDL_Rect s = src_rect ? *src_rect : (SDL_Rect){0, 0, src->w, src->h};
+    SDL_Rect whole, d;
+    if (s.w <= 0 || s.h <= 0 || col.a == 0 || !frame_clip(rect, &whole, &d))
+        return;
+
+    // The steps through the source for every pixel of the frame, exactly one pixel when it's drawn 1:1
+    const Uint32 du = ((Uint32)s.w << 16) / whole.w, dv = ((Uint32)s.h << 16) / whole.h;
+    const Uint32 u = (Uint32)(d.x - whole.x) * du;
+    const _Bool scaled = du != 1 << 16;
+
+    // An opaque surface that isn't tinted is only copied
+    SDL_BlendMode mode;
+    SDL_GetSurfaceBlendMode(src, &mode);
+    const Uint32 mod = pack(col);
+    const _Bool copy = mode == SDL_BLENDMODE_NONE && mod == 0xFFFFFFFF;
+
+    const Uint32* pixels = src->pixels;
+    const int pitch = src->pitch / 4;
+
+    for (int y = d.y; y < d.y + d.h; y++) {
+        const Uint32* line = pixels + (s.y + (((Uint32)(y - whole.y) * dv) >> 16)) * pitch + s.x;
+        Uint32* dst = frame + y * frame_pitch + d.x;
+
+        if (copy && scaled)
+            kernels->scale(dst, line, d.w, u, du);
+        else if (copy)
+            memcpy(dst, line + (u >> 16), d.w * sizeof(Uint32));
+        else {
+            if (scaled) {
+                kernels->scale(row, line, d.w, u, du);
+                line = row;
+            } else
+                line += u >> 16;
+
+            kernels->blend(dst, line, d.w, mod);
+        }
+    }
+
+    perf.composed++;
+}
@@ -1,76 +1,450 @@
+// mmap and posix_madvise
+#define _POSIX_C_SOURCE 200112L
 
-#include <stdlib.h> // random, dynamic allocation
+#include <stdlib.h> // dynamic allocation
 #include <stdio.h> //file
-#include <ctype.h> //isalpha, tolower
-#include <string.h> //strcpy
+#include <ctype.h> //isdigit, isspace
+#include <string.h> //memmove
+#include <sys/stat.h> // stat, fstat
 
-#include "dict.h"
+#ifndef _WIN32
+#include <fcntl.h> // open
+#include <sys/mman.h> // mmap
+#include <unistd.h> // close
+#endif
 
-char** dict_load(FILE* f, size_t* size) {
+#include "dict.h"
+#include "utf8.h"
 
-    *size = 0; 
+// Maps the whole file into memory, falls back to reading it where mmap isn't available
+static const char* file_map(const char* filename, size_t* size) {
+#ifndef _WIN32
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return NULL;
 
-    if (f == NULL)
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size == 0) {
+        close(fd);
         return NULL;
+    }
+
+    *size = st.st_size;
+    void* data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) return NULL;
+
+    // We read it front to back exactly once
+    posix_madvise(data, *size, POSIX_MADV_SEQUENTIAL);
+
+    return data;
+#else
+    FILE* f = fopen(filename, "rb");
+    if (!f) return NULL;
+
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    char* data = len > 0 ? malloc(len) : NULL;
+    if (data && fread(data, 1, len, f) != (size_t)len) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+
+    *size = len;
+    return data;
+#endif
+}
+
+static void file_unmap(const char* data, size_t size) {
+#ifndef _WIN32
+    munmap((void*)data, size);
+#else
+    (void)size;
+    free((void*)data);
+#endif
+}
+
+// Reads a weight token, a decimal number without a sign. Returns NULL if the token isn't one
+static const char* parse_weight(const char* c, const char* end, float* weight) {
+    double w = 0, scale = 1;
+    _Bool digits = 0, point = 0;
+
+    for (; c < end && !isspace((unsigned char)*c); c++) {
+        if (*c == '.' && !point)
+            point = 1;
+        else if (*c >= '0' && *c <= '9') {
+            digits = 1;
+            if (point) w += (*c - '0') * (scale /= 10);
+            else w = w * 10 + (*c - '0');
+        } else return NULL;
+    }
+
+    *weight = w;
+    return digits ? c : NULL;
+}
+
+_Bool dict_load(struct dict* d, const char* filename) {
+
+    memset(d, 0, sizeof(*d));
+
+    size_t fsize;
+    const char* text = file_map(filename, &fsize);
+    if (!text) return 0;
+
+    // The offsets are 32 bit
+    if (fsize >= UINT32_MAX) {
+        file_unmap(text, fsize);
+        return 0;
+    }
+
+    // Every word takes at least two bytes of the file (a letter and a separator), except for the last one,
+    // so this is the most that we can ever need. The index goes first to keep it aligned,
+    // the arena follows and the lengths go last, the unused space is squeezed out afterwards
+    size_t max_words = fsize / 2 + 1;
+    size_t arena_cap = fsize + 1;
+
+    char* block = malloc(max_words * sizeof(uint32_t) + arena_cap + max_words);
+    if (!block) {
+        file_unmap(text, fsize);
+        return 0;
+    }
+
+    uint32_t* offset = (uint32_t*)block;
+    char* arena = block + max_words * sizeof(uint32_t);
+    uint8_t* len = (uint8_t*)arena + arena_cap;
+
+    // Allocated at the first weight
+    float* weight = NULL;
+    _Bool weight_ok = 1, last_scrapped = 1;
+
+    size_t n = 0, used = 0;
+    for (const char* c = text, *end = text + fsize; c < end; ) {
 
-    *size = 1;
-    char** dict = malloc((*size) * sizeof(char*));
-    if (!dict) return NULL;
+        // Skip the whitespace in front of the word
+        while (c < end && isspace((unsigned char)*c)) c++;
+        if (c == end) break;
 
-    char str[WORDLEN];    
-    size_t i = 0;
-    //TODO: replace fscanf with own whitespace-separating function
-    while (fscanf(f, "%11s", str) != EOF) {
+        // The weight of the word in front of it
+        float w;
+        const char* after = (isdigit((unsigned char)*c) || *c == '.') ? parse_weight(c, end, &w) : NULL;
+        if (after) {
+            c = after;
+            if (last_scrapped) continue;
 
-        // This prevents splitting a word into two parts if it's too long
-        for (int c; (c = fgetc(f)) != EOF && !isspace(c); )
-        ;
+            if (!weight && weight_ok) {
+                if ((weight = malloc(max_words * sizeof(float))))
+                    for (size_t i = 0; i < n; i++) weight[i] = 1;
+                else weight_ok = 0;
+            }
+            if (weight) weight[n-1] = w;
+            continue;
+        }
 
-        // Scrap any words that contain other characters than a-z
+        // Copy the word, too long words are cut to WORDLEN-1 letters
+        // and any words that contain other characters than letters are scrapped.
+        // A lowercase letter takes as many bytes as the original, so the arena still fits
+        size_t l = 0, letters = 0;
         _Bool scrap = 0;
-        for (char* c = str; *c; c++)
-            if (!isalpha(*c)) { 
-                scrap = 1; 
-                break; 
-            } else *c = tolower(*c);
-        
+        while (c < end && !isspace((unsigned char)*c)) {
+            uint32_t cp = utf8_letter(utf8_decode(&c, end));
+            if (letters >= WORDLEN-1) continue;
+
+            if (!cp) scrap = 1;
+            else l += utf8_encode(cp, &arena[used + l]);
+            letters++;
+        }
+
+        last_scrapped = scrap;
         if (scrap)
             continue;
 
-        while (i >= *size) {
+        if (weight) weight[n] = 1;
+        arena[used + l] = '\0';
+        offset[n] = used;
+        len[n] = l;
+        n++;
+        used += l + 1;
+    }
 
-            size_t old_dict_size = *size;
-            char** old_dict = dict;
+    file_unmap(text, fsize);
 
-            dict = realloc(dict, (*size*=2) * sizeof(char*));
-            if (!dict) {
-                dict_destroy(old_dict, old_dict_size);
-                return NULL;
-            }
-        }
+    if (n == 0 || !weight_ok) {
+        free(block);
+        free(weight);
+        return 0;
+    }
+
+    // Pack the arena and the lengths right behind the index, then give back the rest
+    memmove(block + n * sizeof(uint32_t), arena, used);
+    memmove(block + n * sizeof(uint32_t) + used, len, n);
+
+    char* packed = realloc(block, n * sizeof(uint32_t) + used + n);
+    if (packed) block = packed;
+
+    d->block = block;
+    d->size = n;
+    d->offset = (uint32_t*)block;
+    d->arena = block + n * sizeof(uint32_t);
+    d->len = (uint8_t*)d->arena + used;
+
+    if (weight) {
+        float* shrunk = realloc(weight, n * sizeof(float));
+        d->weight = d->parsed = shrunk ? shrunk : weight;
+    }
+
+    return 1;
+}
+
+// The binary dictionary starts with this header, followed by the offsets, the weights if it has them,
+// the widths, the lengths and the arena, all in the native byte order
+struct dict_header {
+    char magic[4];
+    uint32_t version;
+    uint64_t source_size; // of the word list it was compiled from, both 0 if there was none
+    int64_t source_mtime;
+    uint32_t size;
+    uint32_t arena_size;
+    uint8_t glyph_width[26];
+    uint8_t weighted;
+    uint8_t padding[5];
+};
+
+static const char dict_magic[4] = {'W', 'S', 'D', 'B'};
+
+// The size and the modification time of the word list, false if there is none
+static _Bool source_stamp(const char* source, uint64_t* size, int64_t* mtime) {
+    struct stat st;
+    if (!source || stat(source, &st)) return 0;
+
+    *size = st.st_size;
+    *mtime = st.st_mtime;
+    return 1;
+}
 
-        dict[i] = strdup(str);
+_Bool dict_load_bin(struct dict* d, const char* filename, const char* source, const uint8_t glyph_width[26]) {
 
-        i++;
+    memset(d, 0, sizeof(*d));
+
+    size_t fsize;
+    const char* data = file_map(filename, &fsize);
+    if (!data) return 0;
+
+    const struct dict_header* h = (const struct dict_header*)data;
+
+    // Only the sizes are checked, this has to stay O(1). The offsets and the lengths of the words
+    // are trusted, the file comes from dictc (see dict.h)
+    if (fsize < sizeof(*h) || memcmp(h->magic, dict_magic, 4) || h->version != DICT_BIN_VERSION ||
+        h->size == 0 || h->arena_size == 0 || h->weighted > 1 ||
+        fsize != sizeof(*h) + (size_t)h->size * (sizeof(uint32_t) + h->weighted * sizeof(float) + sizeof(uint16_t) + 1) +
+                 h->arena_size ||
+        data[fsize-1] != '\0') {
+        file_unmap(data, fsize);
+        return 0;
+    }
+
+    // The word list has changed since it was compiled
+    uint64_t source_size;
+    int64_t source_mtime;
+    if (source_stamp(source, &source_size, &source_mtime) &&
+        (source_size != h->source_size || source_mtime != h->source_mtime)) {
+        file_unmap(data, fsize);
+        return 0;
+    }
+
+    char* p = (char*)data + sizeof(*h);
+    d->offset = (uint32_t*)p;
+    p += h->size * sizeof(uint32_t);
+    if (h->weighted) {
+        d->weight = (float*)p;
+        p += h->size * sizeof(float);
     }
+    d->width = (uint16_t*)p;
+    p += h->size * sizeof(uint16_t);
+    d->len = (uint8_t*)p;
+    p += h->size;
+    d->arena = p;
+
+    d->size = h->size;
+    d->block = (void*)data;
+#ifndef _WIN32
+    d->mapped = fsize;
+#endif
+
+    // The font has changed since the dictionary was compiled
+    if (memcmp(h->glyph_width, glyph_width, 26))
+        d->width = NULL;
+
+    return 1;
+}
+
+_Bool dict_save_bin(const struct dict* d, const char* filename, const char* source, const uint8_t glyph_width[26]) {
+
+    if (!d->width) return 0;
 
-    // shrink the dictionary to exactly it's size
-    *size = i;
-    {
-        char** old_dict = dict;
-        dict = realloc(dict, *size * sizeof(char*));
-        if (!dict) {
-            dict_destroy(old_dict, *size); 
-            return NULL;
+    // The arena ends with the last word
+    size_t arena_size = d->offset[d->size-1] + d->len[d->size-1] + 1;
+
+    struct dict_header h = {0};
+    memcpy(h.magic, dict_magic, 4);
+    h.version = DICT_BIN_VERSION;
+    h.size = d->size;
+    h.arena_size = arena_size;
+    memcpy(h.glyph_width, glyph_width, 26);
+    h.weighted = d->weight != NULL;
+    source_stamp(source, &h.source_size, &h.source_mtime);
+
+    FILE* f = fopen(filename, "wb");
+    if (!f) return 0;
+
+    _Bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+               fwrite(d->offset, sizeof(uint32_t), d->size, f) == d->size &&
+               (!d->weight || fwrite(d->weight, sizeof(float), d->size, f) == d->size) &&
+               fwrite(d->width, sizeof(uint16_t), d->size, f) == d->size &&
+               fwrite(d->len, 1, d->size, f) == d->size &&
+               fwrite(d->arena, 1, arena_size, f) == arena_size;
+
+    return fclose(f) == 0 && ok;
+}
+
+_Bool dict_measure(struct dict* d, const uint8_t glyph_width[26], unsigned (*other_width)(uint32_t cp)) {
+    if (d->width) return 1;
+
+    d->measured = malloc(d->size * sizeof(uint16_t));
+    if (!d->measured) return 0;
+
+    for (size_t i = 0; i < d->size; i++) {
+        unsigned sum = 0;
+        for (const char* c = dict_word(d, i); *c; ) {
+            uint32_t cp = utf8_next(&c);
+            sum += cp - 'a' < 26 ? glyph_width[cp-'a'] : other_width(cp);
         }
+        d->measured[i] = sum;
+    }
+
+    d->width = d->measured;
+    return 1;
+}
+
+void dict_destroy(struct dict* d) {
+    free(d->measured);
+    free(d->parsed);
+
+    if (d->mapped)
+        file_unmap(d->block, d->mapped);
+    else
+        free(d->block);
+
+    memset(d, 0, sizeof(*d));
+}
+
+// The distinct bigrams of a word, returns how many there are
+static size_t word_bigrams(const char* word, uint16_t bigrams[WORDLEN]) {
+    size_t n = 0;
+    for (const char* c = word; c[0] && c[1]; c++) {
+        // The bytes of the other letters are never a-z
+        if ((unsigned)(c[0]-'a') >= 26 || (unsigned)(c[1]-'a') >= 26) continue;
+        uint16_t b = (c[0]-'a') * 26 + (c[1]-'a');
+
+        size_t i = 0;
+        while (i < n && bigrams[i] != b) i++;
+        if (i == n) bigrams[n++] = b;
+    }
+    return n;
+}
+
+_Bool bigram_index_build(struct bigram_index* idx, const struct dict* d) {
+    memset(idx, 0, sizeof(*idx));
+    uint16_t bigrams[WORDLEN];
+
+    // Count the postings first, then every bigram gets its place in one array of IDs
+    size_t total = 0;
+    for (size_t i = 0; i < d->size; i++) {
+        size_t n = word_bigrams(dict_word(d, i), bigrams);
+        for (size_t b = 0; b < n; b++)
+            idx->count[bigrams[b]]++;
+        total += n;
+    }
+
+    size_t blocks = 0;
+    for (size_t b = 0; b < BIGRAMS; b++) {
+        idx->skip_start[b] = blocks;
+        blocks += (idx->count[b] + BIGRAM_BLOCK-1) / BIGRAM_BLOCK;
+    }
+    idx->skip_start[BIGRAMS] = blocks;
+
+    // Never empty, so that malloc can't return NULL for nothing
+    uint32_t* ids = malloc((total + 1) * sizeof(uint32_t));
+    uint32_t* fill = malloc(BIGRAMS * sizeof(uint32_t));
+    idx->skip_id = malloc((blocks + 1) * sizeof(uint32_t));
+    idx->skip_offset = malloc((blocks + 1) * sizeof(uint32_t));
+    // A delta takes 5 bytes at most
+    idx->data = malloc(total * 5 + 1);
+    if (!ids || !fill || !idx->skip_id || !idx->skip_offset || !idx->data) {
+        free(ids);
+        free(fill);
+        bigram_index_destroy(idx);
+        return 0;
+    }
+
+    for (size_t b = 0, at = 0; b < BIGRAMS; at += idx->count[b++])
+        fill[b] = at;
+
+    // The words go in in order, so every bigram's IDs are sorted
+    for (size_t i = 0; i < d->size; i++) {
+        size_t n = word_bigrams(dict_word(d, i), bigrams);
+        for (size_t b = 0; b < n; b++)
+            ids[fill[bigrams[b]]++] = i;
     }
 
-    return dict;
+    const uint32_t* list = ids;
+    for (size_t b = 0; b < BIGRAMS; list += idx->count[b++])
+        for (size_t k = 0; k < idx->count[b]; k++) {
+            if (k % BIGRAM_BLOCK == 0) {
+                size_t block = idx->skip_start[b] + k / BIGRAM_BLOCK;
+                idx->skip_id[block] = list[k];
+                idx->skip_offset[block] = idx->size;
+                continue;
+            }
+
+            uint32_t delta = list[k] - list[k-1];
+            for (; delta >= 0x80; delta >>= 7)
+                idx->data[idx->size++] = (delta & 0x7f) | 0x80;
+            idx->data[idx->size++] = delta;
+        }
+
+    free(ids);
+    free(fill);
+
+    uint8_t* shrunk = realloc(idx->data, idx->size + 1);
+    if (shrunk) idx->data = shrunk;
+
+    return 1;
 }
 
-void dict_destroy(char** dict, size_t size) {
-    for (size_t w = 0; w < size; w++)
-        free(dict[w]);
-    free(dict);
+void bigram_index_destroy(struct bigram_index* idx) {
+    free(idx->skip_id);
+    free(idx->skip_offset);
+    free(idx->data);
+    memset(idx, 0, sizeof(*idx));
 }
 
+uint32_t bigram_index_get(const struct bigram_index* idx, size_t bigram, size_t k) {
+    size_t block = idx->skip_start[bigram] + k / BIGRAM_BLOCK;
+    uint32_t id = idx->skip_id[block];
+    const uint8_t* p = idx->data + idx->skip_offset[block];
+
+    for (size_t n = k % BIGRAM_BLOCK; n > 0; n--) {
+        uint32_t delta = 0;
+        for (unsigned shift = 0; ; shift += 7) {
+            uint8_t byte = *p++;
+            delta |= (uint32_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) break;
+        }
+        id += delta;
+    }
+
+    return id;
+}
@@ -0,0 +1,418 @@
+#include "dictstream.h"
+
+#include <ctype.h> // isalpha, isspace, tolower
+#include <stdio.h> // FILE
+#include <stdlib.h> // malloc, qsort
+#include <string.h> // memcpy, strlen
+
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#endif
+
+// The thread reads this much at once and takes the lock once per chunk
+#define STREAM_CHUNK 65536
+// Once the game is running, the thread pauses this long between chunks, in ms
+#define STREAM_DELAY 10
+
+// Reads the corpus plain, or decompressed by the extension (gzip reads plain files as well)
+struct reader {
+    FILE* f;
+#ifdef WITH_ZLIB
+    gzFile gz;
+#endif
+#ifdef WITH_ZSTD
+    ZSTD_DCtx* zstd;
+    ZSTD_inBuffer in;
+    char* in_buf;
+    size_t in_cap;
+#endif
+};
+
+static _Bool has_extension(const char* filename, const char* ext) {
+    size_t len = strlen(filename), ext_len = strlen(ext);
+    return len >= ext_len && !strcmp(filename + len - ext_len, ext);
+}
+
+static _Bool reader_open(struct reader* r, const char* filename) {
+    memset(r, 0, sizeof(*r));
+
+#ifdef WITH_ZSTD
+    if (has_extension(filename, ".zst")) {
+        r->in_cap = ZSTD_DStreamInSize();
+        r->in_buf = malloc(r->in_cap);
+        r->zstd = ZSTD_createDCtx();
+        r->f = fopen(filename, "rb");
+        r->in = (ZSTD_inBuffer){r->in_buf, 0, 0};
+        return r->in_buf && r->zstd && r->f;
+    }
+#else
+    if (has_extension(filename, ".zst")) {
+        fprintf(stderr, "%s is compressed with zstd, build with WITH_ZSTD=1 to read it\n", filename);
+        return 0;
+    }
+#endif
+#ifdef WITH_ZLIB
+    return (r->gz = gzopen(filename, "rb")) != NULL;
+#else
+    if (has_extension(filename, ".gz")) {
+        fprintf(stderr, "%s is compressed with gzip, build with WITH_ZLIB=1 to read it\n", filename);
+        return 0;
+    }
+    return (r->f = fopen(filename, "rb")) != NULL;
+#endif
+}
+
+// Returns 0 at the end (or on an error)
+static size_t reader_read(struct reader* r, char* buf, size_t size) {
+#ifdef WITH_ZSTD
+    if (r->zstd) {
+        ZSTD_outBuffer out = {buf, size, 0};
+        while (out.pos == 0) {
+            if (r->in.pos == r->in.size) {
+                r->in.size = fread(r->in_buf, 1, r->in_cap, r->f);
+                r->in.pos = 0;
+                if (r->in.size == 0) return 0;
+            }
+            if (ZSTD_isError(ZSTD_decompressStream(r->zstd, &out, &r->in))) return 0;
+        }
+        return out.pos;
+    }
+#endif
+#ifdef WITH_ZLIB
+    int n = gzread(r->gz, buf, size);
+    return n > 0 ? (size_t)n : 0;
+#else
+    return fread(buf, 1, size, r->f);
+#endif
+}
+
+static void reader_close(struct reader* r) {
+#ifdef WITH_ZSTD
+    ZSTD_freeDCtx(r->zstd);
+    free(r->in_buf);
+#endif
+#ifdef WITH_ZLIB
+    if (r->gz) gzclose(r->gz);
+#endif
+    if (r->f) fclose(r->f);
+}
+
+static void enqueue(struct dict_stream* s, size_t slot) {
+    if (s->queued[slot]) return;
+
+    s->queue[(s->queue_head + s->queue_len++) % s->capacity] = slot;
+    s->queued[slot] = 1;
+}
+
+// The sampling state of the thread
+struct sampler {
+    struct rng rng;
+    uint64_t seen; // the words of this pass
+    uint64_t pass_words; // the words of the whole corpus, known after the first pass
+    uint64_t picked; // the words picked in this pass, after the first one
+    _Bool seeded; // the working set came from random offsets
+};
+
+// Whether the corpus is plain text, the compressed ones can only be read from the start
+static _Bool is_plain(FILE* f) {
+    unsigned char magic[4] = {0};
+    size_t n = fread(magic, 1, 4, f);
+
+    return !(n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) &&
+           !(n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd);
+}
+
+static int cmp_offset(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Fills the working set with the words that follow random offsets of a plain corpus, so that the game
+// starts with words from all over it. A word after a long one is a bit more likely to be taken.
+// The offsets are sorted and an offset that falls before the end of the last word takes the next one,
+// so no word is taken twice. False if the corpus is compressed or has too few words for that
+static _Bool seed_offsets(struct dict_stream* s, struct rng* rng) {
+    FILE* f = fopen(s->filename, "rb");
+    if (!f) return 0;
+    // Every offset only reads a few bytes
+    setvbuf(f, NULL, _IOFBF, 256);
+
+    long size = is_plain(f) && !fseek(f, 0, SEEK_END) ? ftell(f) : 0;
+    uint64_t* offsets = size > 0 ? malloc(s->capacity * sizeof(uint64_t)) : NULL;
+    if (!offsets) {
+        fclose(f);
+        return 0;
+    }
+
+    for (size_t i = 0; i < s->capacity; i++)
+        offsets[i] = rng_range(rng, size);
+    qsort(offsets, s->capacity, sizeof(uint64_t), cmp_offset);
+    rewind(f);
+
+    long pos = 0; // where the last word ended
+    size_t filled = 0;
+    for (; filled < s->capacity; filled++) {
+        int c;
+        if ((long)offsets[filled] > pos) {
+            if (fseek(f, offsets[filled] - 1, SEEK_SET)) break;
+            // The rest of the word the offset landed in
+            while ((c = getc(f)) != EOF && !isspace(c));
+        }
+
+        // The same rules as in dict_load
+        char* word = s->sample[filled];
+        size_t len;
+        _Bool scrap;
+        do {
+            len = 0;
+            scrap = 0;
+            while ((c = getc(f)) != EOF && isspace(c));
+            for (; c != EOF && !isspace(c); c = getc(f))
+                if (len < WORDLEN-1) {
+                    if (!isalpha(c)) scrap = 1;
+                    word[len++] = tolower(c);
+                }
+        } while (len && scrap);
+
+        if (!len) break;
+        word[len] = '\0';
+        pos = ftell(f);
+    }
+
+    free(offsets);
+    fclose(f);
+
+    // The first pass reads it all soon enough
+    if (filled < s->capacity) return 0;
+
+    for (size_t i = 0; i < s->capacity; i++)
+        enqueue(s, i);
+    s->filled = s->capacity;
+    return 1;
+}
+
+// The later passes are a selection sample: exactly as many words as there are slots are picked from every
+// pass, each one with the probability that keeps the sample uniform, and they go into the slots in order.
+// So every slot is replaced once per pass and two slots never hold the same word of the same pass.
+// The first pass only counts the words when the working set came from random offsets, otherwise it's
+// a reservoir sample. The game starts once the reservoir is full then, with the first words of the corpus,
+// which are replaced as the first pass goes on
+static void offer(struct dict_stream* s, struct sampler* sm, const char* word, size_t len) {
+    uint64_t n = ++sm->seen;
+    size_t slot;
+
+    if (sm->pass_words) {
+        // The file can change between the passes
+        if (n > sm->pass_words || sm->picked == s->filled ||
+            rng_range(&sm->rng, sm->pass_words - n + 1) >= s->filled - sm->picked)
+            return;
+        slot = sm->picked++;
+    } else if (sm->seeded)
+        return;
+    else if (n <= s->capacity)
+        slot = s->filled++;
+    else if ((slot = rng_range(&sm->rng, n)) >= s->capacity)
+        return;
+
+    memcpy(s->sample[slot], word, len);
+    s->sample[slot][len] = '\0';
+    enqueue(s, slot);
+}
+
+static int stream_thread(void* data) {
+    struct dict_stream* s = data;
+    struct sampler sm = {0};
+    rng_seed(&sm.rng, SDL_GetPerformanceCounter());
+
+    char* chunk = malloc(STREAM_CHUNK);
+    _Bool quit = !chunk;
+
+    SDL_LockMutex(s->lock);
+    if (!quit && (sm.seeded = seed_offsets(s, &sm.rng))) {
+        s->ready = 1;
+        SDL_CondSignal(s->ready_cond);
+    }
+    SDL_UnlockMutex(s->lock);
+
+    while (!quit) {
+        struct reader r;
+        if (!reader_open(&r, s->filename)) {
+            reader_close(&r);
+            break;
+        }
+
+        // A word can span two chunks, the same rules as in dict_load
+        char word[WORDLEN];
+        size_t len = 0;
+        _Bool scrap = 0;
+
+        sm.seen = sm.picked = 0;
+        size_t n;
+        while (!quit && (n = reader_read(&r, chunk, STREAM_CHUNK)) > 0) {
+            SDL_LockMutex(s->lock);
+
+            for (size_t i = 0; i < n; i++) {
+                unsigned char c = chunk[i];
+                if (isspace(c)) {
+                    if (len && !scrap) offer(s, &sm, word, len);
+                    len = 0;
+                    scrap = 0;
+                } else if (len < WORDLEN-1) {
+                    if (!isalpha(c)) scrap = 1;
+                    word[len++] = tolower(c);
+                }
+            }
+
+            quit = s->quit;
+            _Bool ready = s->ready;
+            if (!ready && s->filled == s->capacity) {
+                s->ready = 1;
+                SDL_CondSignal(s->ready_cond);
+            }
+            SDL_UnlockMutex(s->lock);
+
+            // Don't take the whole core away from the game
+            if (ready) SDL_Delay(STREAM_DELAY);
+        }
+
+        SDL_LockMutex(s->lock);
+        if (len && !scrap) offer(s, &sm, word, len);
+        quit |= s->quit;
+        SDL_UnlockMutex(s->lock);
+
+        reader_close(&r);
+
+        // Nothing more to sample when the whole corpus fits
+        if (sm.seen <= s->capacity) break;
+        sm.pass_words = sm.seen;
+    }
+
+    free(chunk);
+
+    // Whatever there is, is all there will be
+    SDL_LockMutex(s->lock);
+    if (!s->ready) {
+        s->ready = 1;
+        s->failed = s->filled == 0;
+        SDL_CondSignal(s->ready_cond);
+    }
+    SDL_UnlockMutex(s->lock);
+
+    return 0;
+}
+
+// Copies the newest sample of the slot into the dictionary
+static void apply(struct dict_stream* s, struct dict* d, size_t slot) {
+    const char* word = s->sample[slot];
+    char* dst = d->arena + d->offset[slot];
+
+    unsigned width = 0;
+    size_t len = 0;
+    for (; word[len]; len++) {
+        dst[len] = word[len];
+        width += s->glyph_width[word[len]-'a'];
+    }
+    dst[len] = '\0';
+
+    d->len[slot] = len;
+    d->width[slot] = width;
+}
+
+_Bool dict_stream_open(struct dict_stream* s, struct dict* d, const char* filename, size_t capacity,
+                       const uint8_t glyph_width[26]) {
+
+    memset(s, 0, sizeof(*s));
+    memset(d, 0, sizeof(*d));
+    if (capacity == 0 || capacity > UINT32_MAX / WORDLEN) return 0;
+
+    s->filename = filename;
+    s->capacity = capacity;
+    memcpy(s->glyph_width, glyph_width, 26);
+
+    // The dictionary has a fixed slot for every word, so a word can be replaced in place
+    d->block = malloc(capacity * (sizeof(uint32_t) + WORDLEN + 1));
+    d->measured = malloc(capacity * sizeof(uint16_t));
+    s->sample = malloc(capacity * WORDLEN);
+    s->queue = malloc(capacity * sizeof(uint32_t));
+    s->queued = calloc(capacity, 1);
+    s->lock = SDL_CreateMutex();
+    s->ready_cond = SDL_CreateCond();
+
+    if (!d->block || !d->measured || !s->sample || !s->queue || !s->queued || !s->lock || !s->ready_cond)
+        goto fail;
+
+    d->offset = d->block;
+    d->arena = (char*)d->block + capacity * sizeof(uint32_t);
+    d->len = (uint8_t*)d->arena + capacity * WORDLEN;
+    d->width = d->measured;
+    for (size_t i = 0; i < capacity; i++)
+        d->offset[i] = i * WORDLEN;
+
+    if (!(s->thread = SDL_CreateThread(stream_thread, "dict_stream", s)))
+        goto fail;
+
+    SDL_LockMutex(s->lock);
+    while (!s->ready)
+        SDL_CondWait(s->ready_cond, s->lock);
+
+    _Bool failed = s->failed;
+    d->size = s->filled;
+
+    // Nothing is used yet, the whole first sample goes in
+    for (; s->queue_len; s->queue_len--, s->queue_head = (s->queue_head + 1) % capacity) {
+        apply(s, d, s->queue[s->queue_head]);
+        s->queued[s->queue[s->queue_head]] = 0;
+    }
+    SDL_UnlockMutex(s->lock);
+
+    if (failed) goto fail;
+    return 1;
+
+    fail:
+        dict_stream_close(s);
+        dict_destroy(d);
+        return 0;
+}
+
+void dict_stream_refill(struct dict_stream* s, struct dict* d, const struct wordpool* pool, size_t budget) {
+    if (!s->lock || SDL_TryLockMutex(s->lock)) return;
+
+    if (budget > s->queue_len) budget = s->queue_len;
+
+    for (size_t i = 0; i < budget; i++) {
+        size_t slot = s->queue[s->queue_head];
+        s->queue_head = (s->queue_head + 1) % s->capacity;
+        s->queue_len--;
+
+        // The word is on the screen, try it again later
+        if (pool->slot[slot] >= pool->unused) {
+            s->queue[(s->queue_head + s->queue_len++) % s->capacity] = slot;
+            continue;
+        }
+
+        apply(s, d, slot);
+        s->queued[slot] = 0;
+    }
+
+    SDL_UnlockMutex(s->lock);
+}
+
+void dict_stream_close(struct dict_stream* s) {
+    if (s->thread) {
+        SDL_LockMutex(s->lock);
+        s->quit = 1;
+        SDL_UnlockMutex(s->lock);
+        SDL_WaitThread(s->thread, NULL);
+    }
+
+    SDL_DestroyMutex(s->lock);
+    SDL_DestroyCond(s->ready_cond);
+    free(s->sample);
+    free(s->queue);
+    free(s->queued);
+
+    memset(s, 0, sizeof(*s));
+}
@@ -1,271 +1,591 @@
 #include "game.h"
 #include "dict.h"
+#include "dictstream.h"
 #include "particles.h"
+#include "compose.h"
 #include "text.h"
+#include "perf.h"
+#include "rng.h"
+#include "wordpool.h"
+#include "matcher.h"
+#include "audio.h"
+#include "stats.h"
+#include "alias.h"
+#include "utf8.h"
 
-#include <ctype.h> // isspace
 #include <stddef.h> // size_t
-#include <string.h> // memmove
+#include <string.h> // memmove, memcpy, strlen
 #include <stdio.h> // sprintf
-#include <stdlib.h> // rand
+#include <stdint.h> // uint32_t
+#include <stdlib.h> // malloc
 
 #include <SDL.h>
 #include <SDL_ttf.h>
-#include <SDL_mixer.h>
 
-#define    WORDS 16
+// The height of one lane of the word stream, there can be many words in one lane
+#define    LANE_HEIGHT 18
 
 extern SDL_Renderer* ren;
 
 extern const int WIDTH, HEIGHT, BARHEIGHT;
 
-// Text stuff
-size_t dict_size;
-char** dict;
-_Bool* dict_used_words;
+// Text stuff, shared by all the players
+struct dict dict;
 
-struct {
-    size_t index; // index in the dict array
-    double x, y;    
-} word_arr[WORDS];
+// The number of words in every stream
+static size_t stream_size = 16;
+// The lanes the stream is spread over, there aren't more than words
+static size_t lane_count;
 
-char input_str[WORDLEN];
+// Picks the words by their weights, when the dictionary has them
+static struct alias_table weights;
 
-// The speed of the word stream
-double scroll_speed = 0.3;
+// The words by their bigrams, for the adaptive picks
+static struct bigram_index bigrams;
+static _Bool adaptive = 0;
 
-// Scores
-unsigned cpm = 0; // the chars per minute (in the last minute)
-unsigned cpm_best = 0; // the overall best cpm
-unsigned backspaces = 0; // the number of input character deletions
-unsigned words = 0, chars = 0; // Total characters and words typed in this round
-unsigned round_start = 0; // When the current round started
+// A bigram counts as measured after this many samples, and its history is halved at the limit,
+// so that the recent keystrokes matter the most. The pauses are cut at the maximum
+#define    BIGRAM_MIN_SAMPLES 3
+#define    BIGRAM_HISTORY 64
+#define    BIGRAM_MAX_MS 2000
 
-// Some sound effects
-Mix_Chunk* sound_start;
-Mix_Chunk* sound_pop;
-Mix_Chunk* sound_end;
+// How many times a weighted pick can land on a word that's on the screen already
+// before it falls back to any unused word
+#define    PICK_TRIES 8
 
-// Stores the number of characters typed in the corresponding second one minute ago
-// Used for dynamically updating CPM
-unsigned chars_in_second[60];
+// The cached HUD texts: WPM, CPM, words and chars
+struct text_label hud_labels[4];
+
+// The slots of every game's CPM window
+static size_t window_slots = STATS_SLOTS;
+
+// A streamed corpus replaces the dictionary files when given
+static const char* corpus_file = NULL;
+static size_t corpus_words = DICT_STREAM_WORDS;
+static struct dict_stream corpus;
 
 _Bool game_init() {
     // Load the dictionary
-    FILE* dictf = fopen("res/dict.txt", "r");
-    dict = dict_load(dictf, &dict_size);
-    fclose(dictf);
+    Uint32 load_start = SDL_GetTicks();
 
-    if (!dict)  {
+    // The compiled dictionary (make dict) is preferred, the word list is the fallback
+    uint8_t widths[26];
+    glyph_widths(widths);
+
+    if (corpus_file) {
+        if (!dict_stream_open(&corpus, &dict, corpus_file, corpus_words, widths)) {
+            fprintf(stderr, "Failed to stream the corpus %s\n", corpus_file);
+            return 0;
+        }
+    } else if (!dict_load_bin(&dict, "res/dict.bin", "res/dict.txt", widths) && !dict_load(&dict, "res/dict.txt"))  {
         fprintf(stderr, "Failed to load the dictionary\n");
         return 0;
     }
 
-    fprintf(stdout, "A total of %zu words has been loaded\n", dict_size);
+    // The word list (or an outdated compiled one) is measured here, spawning a word only looks its width up
+    if (!dict_measure(&dict, widths, glyph_advance)) return 0;
+
+    fprintf(stdout, "A total of %zu words has been loaded in %u ms\n", dict.size, SDL_GetTicks() - load_start);
+
+    // A streamed corpus changes all the time, it's not indexed
+    if (adaptive && !corpus_file) {
+        Uint64 build_start = SDL_GetPerformanceCounter();
+        if (!bigram_index_build(&bigrams, &dict)) return 0;
+
+        size_t blocks = bigrams.skip_start[BIGRAMS];
+        fprintf(stdout, "The bigram index has been built in %.2f ms, %zu kB\n",
+                (SDL_GetPerformanceCounter() - build_start) * 1000.0 / SDL_GetPerformanceFrequency(),
+                (bigrams.size + blocks * 2 * sizeof(uint32_t) + sizeof(bigrams)) / 1024);
+    }
+
+    if (dict.weight) {
+        Uint64 build_start = SDL_GetPerformanceCounter();
+        if (!alias_build(&weights, dict.weight, dict.size)) return 0;
 
-    // Allocate the used_words array
-    dict_used_words = calloc(dict_size, sizeof(_Bool));
-    if (!dict_used_words) return 0;
+        fprintf(stdout, "The word weights have been built into an alias table in %.2f ms, %zu kB\n",
+                (SDL_GetPerformanceCounter() - build_start) * 1000.0 / SDL_GetPerformanceFrequency(),
+                dict.size * 2 * sizeof(uint32_t) / 1024);
+    }
 
-    // Load the sfx
-    sound_start = Mix_LoadWAV("res/start.wav");
-    sound_pop = Mix_LoadWAV("res/pop.wav");
-    sound_end = Mix_LoadWAV("res/end.wav");
+    // The word stream, the lanes are as narrow as the text allows, but there aren't more than words
+    lane_count = (HEIGHT-BARHEIGHT) / LANE_HEIGHT;
+    if (lane_count > stream_size) lane_count = stream_size;
 
     return 1;
 }
 
 void game_dealloc() {
-    dict_destroy(dict, dict_size);
-    free(dict_used_words);
+    dict_stream_close(&corpus);
+    dict_destroy(&dict);
+    alias_destroy(&weights);
+    bigram_index_destroy(&bigrams);
+    particles_dealloc();
+
+    for (size_t i = 0; i < 4; i++)
+        label_destroy(&hud_labels[i]);
+}
+
+_Bool game_create(struct game* g) {
+    memset(g, 0, sizeof(*g));
+
+    // Allocate the unused words pool
+    if (!wordpool_init(&g->unused, dict.size)) return 0;
+
+    struct word_stream* s = &g->stream;
+    s->x = malloc(stream_size * sizeof(float));
+    s->y = malloc(stream_size * sizeof(float));
+    s->prev_x = malloc(stream_size * sizeof(float));
+    s->index = malloc(stream_size * sizeof(uint32_t));
+    s->width = malloc(stream_size * sizeof(uint16_t));
+    s->lane = malloc(stream_size * sizeof(uint16_t));
+    if (!s->x || !s->y || !s->prev_x || !s->index || !s->width || !s->lane) {
+        game_destroy(g);
+        return 0;
+    }
+
+    // The trie of the words in the stream
+    if (!matcher_init(&g->matcher, stream_size) || !stats_window_init(&g->cpm_window, window_slots)) {
+        game_destroy(g);
+        return 0;
+    }
 
-    Mix_FreeChunk(sound_start);
-    Mix_FreeChunk(sound_pop);
-    Mix_FreeChunk(sound_end);
+    return 1;
 }
 
-// Pick an unused word from the dictionary
-size_t dict_pick() {
-    // TODO: we can only index RAND_MAX words
+void game_destroy(struct game* g) {
+    wordpool_destroy(&g->unused);
+    matcher_destroy(&g->matcher);
+    stats_window_destroy(&g->cpm_window);
+
+    free(g->stream.x);
+    free(g->stream.y);
+    free(g->stream.prev_x);
+    free(g->stream.index);
+    free(g->stream.width);
+    free(g->stream.lane);
+    memset(&g->stream, 0, sizeof(g->stream));
+}
 
-    size_t index = rand() % dict_size;
+// Pick an unused word from the dictionary, by the weights if there are any. The words on the screen
+// are rejected, they're few enough that this almost never takes more than one try
+static size_t dict_pick(struct game* g) {
 
-    for (size_t count = 0; dict_used_words[index]; count++) {
+    // Every other word has one of the slowest bigrams, a word with several of them comes up more often
+    if (g->weak_words && rng_range(&g->rng, 2) == 0)
+        for (size_t t = 0; t < PICK_TRIES; t++) {
+            size_t k = rng_range(&g->rng, g->weak_words), w = 0;
+            while (k >= bigrams.count[g->weak[w]])
+                k -= bigrams.count[g->weak[w++]];
 
-        // If there are no unused words, we have no other choice than to return an already used one
-        if (count >= dict_size) 
-            return index;
+            size_t word = bigram_index_get(&bigrams, g->weak[w], k);
+            if (wordpool_take(&g->unused, word))
+                return word;
+        }
 
-        index++; 
-        index %= dict_size;
+    for (size_t t = 0; weights.size && t < PICK_TRIES; t++) {
+        size_t word = alias_pick(&weights, &g->rng);
+        if (wordpool_take(&g->unused, word))
+            return word;
     }
 
-    return index;
+    return wordpool_pick(&g->unused, &g->rng);
+}
+
+// Put a new word into the slot somewhere left of the screen
+static void stream_spawn(struct game* g, size_t i, size_t lane) {
+    struct word_stream* s = &g->stream;
+
+    s->index[i] = dict_pick(g);
+    s->width[i] = dict.width[s->index[i]];
+    s->lane[i] = lane;
+
+    s->x[i] = s->prev_x[i] = 0 - (int)rng_range(&g->rng, WIDTH) - s->width[i];
+    s->y[i] = (int)((double)(HEIGHT-BARHEIGHT)/lane_count * (double)lane);
+
+    matcher_insert(&g->matcher, i, dict_word(&dict, s->index[i]));
 }
 
-void game_start() {
+void game_start(struct game* g) {
 
-    // Initialise the random generator with a somewhat-random seed
-    srand(SDL_GetTicks());
+    // Initialise the random generator with a somewhat-random seed, unless we were given one
+    rng_seed(&g->rng, g->seed ? g->seed : SDL_GetTicks());
+
+    // Every round starts at the same speed, otherwise replays of later rounds would diverge
+    g->scroll_speed = 0.3;
 
     // Initialize the scores
-    words = chars = 0;
-    cpm = 0;
-    cpm_best = 0;
-    backspaces = 0;
-    round_start = SDL_GetTicks();
-
-    // Clear the char_in_second table
-    memset(chars_in_second, 0, 60 * sizeof(chars_in_second[0]));
+    g->words = g->chars = 0;
+    g->cpm = 0;
+    g->cpm_best = 0;
+    g->backspaces = 0;
+    g->time = 0;
+    g->round_start = g->time;
+
+    stats_window_reset(&g->cpm_window);
+    // A replay starts from scratch too, so the player is measured anew every round
+    memset(g->bigram_ms, 0, sizeof(g->bigram_ms));
+    memset(g->bigram_count, 0, sizeof(g->bigram_count));
+    g->last_key = 0;
+    g->weak_count = g->weak_words = 0;
     // Mark all words in the dictionary as unused
-    memset(dict_used_words, 0, dict_size * sizeof(dict_used_words[0]));
+    wordpool_reset(&g->unused);
+    matcher_reset(&g->matcher);
 
-    // Initialize the word stream
-    for (size_t i = 0; i < WORDS; i++) {
-        word_arr[i].index = dict_pick();
-        word_arr[i].x = 0 - rand() % WIDTH - (int)cached_string_width(1, dict[word_arr[i].index]);
-        word_arr[i].y = (int)((double)(HEIGHT-BARHEIGHT)/WORDS * (double) i);
-    }
+    // Initialize the word stream, the lanes are filled evenly
+    for (size_t i = 0; i < stream_size; i++)
+        stream_spawn(g, i, i % lane_count);
 
-    // Reset the particles
-    particles_reset();
-    
     // Initailise the input string
-    input_str[0] = '\0';
+    g->input[0] = '\0';
+
+    if (g->visible) {
+        // Reset the particles
+        particles_reset();
+
+        audio_play(SOUND_START);
+    }
+}
 
-    Mix_PlayChannel(-1, sound_start, 0);
+// The time since the previous key of the word goes to the bigram of the two
+static void time_bigram(struct game* g, uint32_t key) {
+    // Only the bigrams of a-z are timed
+    if (key - 'a' >= 26) {
+        g->last_key = 0;
+        return;
+    }
+
+    if (g->last_key) {
+        size_t b = (g->last_key-'a') * 26 + (key-'a');
+        Uint32 ms = g->time - g->last_key_time;
+
+        g->bigram_ms[b] += ms < BIGRAM_MAX_MS ? ms : BIGRAM_MAX_MS;
+        if (++g->bigram_count[b] >= BIGRAM_HISTORY) {
+            g->bigram_ms[b] /= 2;
+            g->bigram_count[b] /= 2;
+        }
+    }
+
+    g->last_key = key;
+    g->last_key_time = g->time;
 }
 
-//TODO: it is not really nice when you type a word that is on the screen multiple times
-// maybe it should remove all of them, or the one that is the closest to the right?
-void game_textinput(const char* str) {
-    // Only write down alphabetical characters
-    for (const char* c = str; *c && strlen(input_str) < WORDLEN-1; c++)
-        if (!isalpha(*c)) continue;
-        else {
-            strcat(input_str, (char[]){*c, '\0'});
+// The WEAK_BIGRAMS measured bigrams with the slowest average that some words have
+static void find_weak_bigrams(struct game* g) {
+    g->weak_count = g->weak_words = 0;
+
+    for (size_t b = 0; b < BIGRAMS; b++) {
+        if (g->bigram_count[b] < BIGRAM_MIN_SAMPLES || bigrams.count[b] == 0)
+            continue;
+
+        // Insertion into the sorted few, the averages are compared as fractions so that it's exact
+        size_t i = g->weak_count;
+        while (i > 0 && (uint64_t)g->bigram_ms[b] * g->bigram_count[g->weak[i-1]] >
+                        (uint64_t)g->bigram_ms[g->weak[i-1]] * g->bigram_count[b]) {
+            if (i < WEAK_BIGRAMS) g->weak[i] = g->weak[i-1];
+            i--;
+        }
+        if (i < WEAK_BIGRAMS) {
+            g->weak[i] = b;
+            if (g->weak_count < WEAK_BIGRAMS) g->weak_count++;
         }
+    }
+
+    for (size_t i = 0; i < g->weak_count; i++)
+        g->weak_words += bigrams.count[g->weak[i]];
+}
+
+void game_textinput(struct game* g, const char* str) {
+    struct word_stream* s = &g->stream;
+
+    // Only write down the letters, as many as a word can have
+    size_t input_len = strlen(g->input), letters = utf8_length(g->input);
+    for (const char* c = str, *end = str + strlen(str); c < end && letters < WORDLEN-1; ) {
+        uint32_t cp = utf8_letter(utf8_decode(&c, end));
+        if (!cp) continue;
+
+        input_len += utf8_encode(cp, &g->input[input_len]);
+        g->input[input_len] = '\0';
+        letters++;
+        matcher_push(&g->matcher, cp);
+        if (adaptive) time_bigram(g, cp);
+    }
 
-    // Check if the text matches any word in the word stream
-    for (size_t i = 0; i < WORDS; i++) {
-        const char* word = dict[word_arr[i].index];
+    // If the same word is in the stream multiple times, the one closest to the right is typed,
+    // ties go to the lowest slot so that the choice is deterministic
+    size_t i = MATCHER_NONE;
+    for (size_t m = matcher_first_match(&g->matcher); m != MATCHER_NONE; m = matcher_next_match(&g->matcher, m)) {
 
         // If we accidentally write a word that cannot even be seen, ignore it
-        if (word_arr[i].x  < 0)
+        if (s->x[m] < 0)
             continue;
 
-        if (!strcmp(word, input_str)) {
+        if (i == MATCHER_NONE || s->x[m] > s->x[i] || (s->x[m] == s->x[i] && m < i))
+            i = m;
+    }
+
+    if (i == MATCHER_NONE)
+        return;
+
+    const char* word = dict_word(&dict, s->index[i]);
 
-            input_str[0] = '\0'; // Clear the input string
+    g->input[0] = '\0'; // Clear the input string
+    matcher_clear_input(&g->matcher);
 
-            // Add particles for the animation
-            particles_start(word_arr[i].x, word_arr[i].y);
+    // The next word starts without a bigram, and the new word already goes for the slowest ones
+    g->last_key = 0;
+    if (adaptive) find_weak_bigrams(g);
 
-            // The word is not used anymore
-            dict_used_words[word_arr[i].index] = 0;
+    // Add particles for the animation
+    if (g->visible)
+        particles_start(s->x[i], s->y[i]);
 
-            // pick a new word, note that this allows picking the same word again
-            word_arr[i].index = dict_pick();
-            word_arr[i].x = 0 - rand() % WIDTH - (int)cached_string_width(1, dict[word_arr[i].index]);
+    // The word is not used anymore
+    wordpool_release(&g->unused, s->index[i]);
 
-            // Increment the scores
-            size_t len = strlen(word);
+    // pick a new word, note that this allows picking the same word again.
+    // It takes over the lane, so every lane keeps as many words as it started with
+    stream_spawn(g, i, s->lane[i]);
 
-            chars_in_second[(SDL_GetTicks()/1000) % 60] += len;
+    // Increment the scores
+    size_t len = utf8_length(word);
 
-            chars += len;
-            cpm += len;
-            words++;
+    stats_window_add(&g->cpm_window, g->time, len);
+
+    g->chars += len;
+    g->cpm = stats_window_sum(&g->cpm_window, g->time);
+    g->words++;
+
+    // The CPM only ever grows here, so this is where it peaks
+    if (g->cpm > g->cpm_best) g->cpm_best = g->cpm;
+
+    if (g->visible)
+        audio_play(SOUND_POP);
+}
 
-            if (cpm > cpm_best) cpm_best = cpm;
+const char* game_input(const struct game* g) {
+    return g->input;
+}
 
-            Mix_PlayChannel(-1, sound_pop, 0);
+const char* game_target(const struct game* g) {
+    const struct word_stream* s = &g->stream;
+    const char* target = NULL;
+    double target_x = 0;
 
-            break;
+    for (size_t i = 0; i < stream_size; i++)
+        if (s->x[i] >= 0 && (!target || s->x[i] > target_x)) {
+            target = dict_word(&dict, s->index[i]);
+            target_x = s->x[i];
         }
+
+    return target;
+}
+
+void game_input_delete(struct game* g, size_t num) {
+    size_t input_len = strlen(g->input), deleted = 0;
+    for (; deleted < num && input_len > 0; deleted++) {
+        input_len = utf8_back(g->input, input_len);
+        matcher_pop(&g->matcher);
+    }
+
+    if (deleted > 0) {
+        g->input[input_len] = '\0';
+        g->backspaces+=deleted;
+        g->last_key = 0;
+    }
+}
+
+_Bool game_update(struct game* g) {
+
+    g->time += TICK_MS;
+
+    // Kept branchless, so that the compiler can vectorize it
+    memcpy(g->stream.prev_x, g->stream.x, stream_size * sizeof(float));
+
+    const float speed = g->scroll_speed, right = WIDTH;
+    float* restrict x = g->stream.x;
+    unsigned out = 0;
+    for (size_t i = 0; i < stream_size; i++) {
+        x[i] += speed;
+        out += x[i] > right;
     }
+
+    // If one of the words gets too far right, we lose
+    if (out) {
+        if (g->visible) audio_play(SOUND_END);
+        return 0;
+    }
+
+    // Adjust the scrolling speed
+    g->scroll_speed += 0.00001;
+
+    if (g->visible)
+        particles_update();
+
+    // Swap in some of the new words of the corpus
+    if (corpus_file)
+        dict_stream_refill(&corpus, &dict, &g->unused, 16);
+
+    // Update CPM, the words typed a minute ago drop out
+    g->cpm = stats_window_sum(&g->cpm_window, g->time);
+
+    return 1;
 }
 
-void game_input_delete(size_t num) {
-    size_t input_str_len = strlen(input_str);
-    if (input_str_len > 0) {
-        input_str[input_str_len-num] = '\0';
-        backspaces+=num;
+// Grows the arrays of the snapshot to hold the words and the particles
+static _Bool snapshot_reserve(struct game_snapshot* snap, size_t words, size_t particles) {
+    if (words > snap->words_cap) {
+        float* x = realloc(snap->x, words * sizeof(float));
+        if (x) snap->x = x;
+        float* prev_x = realloc(snap->prev_x, words * sizeof(float));
+        if (prev_x) snap->prev_x = prev_x;
+        float* y = realloc(snap->y, words * sizeof(float));
+        if (y) snap->y = y;
+        char (*word)[WORDBYTES] = realloc(snap->word, words * WORDBYTES);
+        if (word) snap->word = word;
+        uint16_t* width = realloc(snap->width, words * sizeof(uint16_t));
+        if (width) snap->width = width;
+        uint8_t* highlight = realloc(snap->highlight, words);
+        if (highlight) snap->highlight = highlight;
+
+        if (!x || !prev_x || !y || !word || !width || !highlight) return 0;
+        snap->words_cap = words;
+    }
+
+    if (particles > snap->particles_cap) {
+        size_t cap = snap->particles_cap ? snap->particles_cap : 256;
+        while (cap < particles) cap *= 2;
+
+        float* px = realloc(snap->particle_x, cap * sizeof(float));
+        if (px) snap->particle_x = px;
+        float* py = realloc(snap->particle_y, cap * sizeof(float));
+        if (py) snap->particle_y = py;
+        float* pvx = realloc(snap->particle_vx, cap * sizeof(float));
+        if (pvx) snap->particle_vx = pvx;
+
+        if (!px || !py || !pvx) return 0;
+        snap->particles_cap = cap;
     }
+
+    return 1;
 }
 
-_Bool game_draw() {
+_Bool game_snapshot(const struct game* g, struct game_snapshot* snap) {
+    const struct word_stream* s = &g->stream;
 
-    for (size_t i = 0, input_str_len = strlen(input_str); i < WORDS; i++) {
+    size_t particles = g->visible ? particles_count() : 0;
+    if (!snapshot_reserve(snap, stream_size, particles))
+        return 0;
 
-        word_arr[i].x += scroll_speed;
+    // The words only move right, the ones that are still left of the screen can't be drawn before the next tick
+    snap->words = 0;
+    for (size_t i = 0; i < stream_size; i++) {
+        if (s->x[i] + s->width[i] / 2 <= 0)
+            continue;
 
-        // If one of the words gets too far right, we lose
-        if (word_arr[i].x > WIDTH) {
-            Mix_PlayChannel(-1, sound_end, 0);
-            return 0;
-        }
+        size_t w = snap->words++;
+        snap->x[w] = s->x[i];
+        snap->prev_x[w] = s->prev_x[i];
+        snap->y[w] = s->y[i];
+        memcpy(snap->word[w], dict_word(&dict, s->index[i]), dict.len[s->index[i]] + 1);
+        snap->width[w] = s->width[i];
+        snap->highlight[w] = matcher_highlight(&g->matcher, i);
+    }
+
+    snap->particles = particles;
+    if (particles)
+        particles_copy(snap->particle_x, snap->particle_y, snap->particle_vx);
+
+    memcpy(snap->input, g->input, sizeof(snap->input));
+
+    snap->cpm = g->cpm;
+    snap->cpm_best = g->cpm_best;
+    snap->backspaces = g->backspaces;
+    snap->words_typed = g->words;
+    snap->chars = g->chars;
+    snap->survived = g->time - g->round_start;
+    return 1;
+}
+
+void game_snapshot_destroy(struct game_snapshot* snap) {
+    free(snap->x);
+    free(snap->prev_x);
+    free(snap->y);
+    free(snap->word);
+    free(snap->width);
+    free(snap->highlight);
+    free(snap->particle_x);
+    free(snap->particle_y);
+    free(snap->particle_vx);
+    memset(snap, 0, sizeof(*snap));
+}
 
-        // DRAWING
+void game_draw(const struct game_snapshot* s, double alpha) {
 
-        const char* word = dict[word_arr[i].index];
-        // This checks wheter the word should be highlited when typing it
-        _Bool mismatch = 0;
-        for (size_t c = 0; word[c] && input_str[c] && !(mismatch = (word[c] != input_str[c])); c++);
+    perf_begin(PERF_WORDS);
+
+    for (size_t i = 0; i < s->words; i++) {
+
+        // Interpolate between the last two ticks
+        float fx = s->prev_x[i] + (s->x[i] - s->prev_x[i]) * alpha;
+
+        // Skip the words that are still completely left of the screen, they are drawn at half size
+        if (fx + s->width[i] / 2 <= 0)
+            continue;
+
+        const char* word = s->word[i];
+        // How many letters of the word are highlighted as typed
+        size_t highlight = s->highlight[i];
+
+        int x = (int)fx;
         
         // Draw each letter
-        unsigned offset = 0;
-        for (size_t c = 0; word[c]; c++)
-            offset += render_char_cached(!mismatch && c < input_str_len, word[c], (int)word_arr[i].x+offset, (int)word_arr[i].y, 0.5);
+        float offset = 0;
+        for (size_t c = 0; *word; c++)
+            offset += render_char_cached(c < highlight, utf8_next(&word), x+offset, (int)s->y[i], 0.5);
 
     }
 
-    // Adjust the scrolling speed
-    scroll_speed += 0.00001;
+    // The whole word stream goes out in a single draw call
+    render_cached_flush();
+
+    perf_end(PERF_WORDS);
 
     // Draw particles
-    particles_draw(ren);
+    perf_begin(PERF_PARTICLES);
+    particles_draw(s->particle_x, s->particle_y, s->particle_vx, s->particles);
+    perf_end(PERF_PARTICLES);
 
     // Draw the GUI
-    SDL_SetRenderDrawColor(ren, 255, 255, 255, 255);
-    SDL_RenderFillRect(ren, &(SDL_Rect){0, HEIGHT-BARHEIGHT, WIDTH, 3});
+    perf_begin(PERF_HUD);
 
-    SDL_SetRenderDrawColor(ren, 0, 0, 0, 100);
-    SDL_RenderFillRect(ren, &(SDL_Rect){0, HEIGHT-BARHEIGHT+3, WIDTH, BARHEIGHT-3});
+    compose_fill((SDL_FRect){0, HEIGHT-BARHEIGHT, WIDTH, 3}, (SDL_Color){255, 255, 255, 255});
+    compose_fill((SDL_FRect){0, HEIGHT-BARHEIGHT+3, WIDTH, BARHEIGHT-3}, (SDL_Color){0, 0, 0, 100});
 
-    unsigned twid = cached_string_width(2, input_str);
-    render_string_cached(2, input_str, WIDTH/2-twid/2, HEIGHT-BARHEIGHT+8, 1.0);
-
-    // Update CPM
-    {
-        // This is the index of the second that was one minute ago
-        size_t sec = (SDL_GetTicks() / 1000 + 1) % 60;
-
-        cpm -= chars_in_second[sec];
-        chars_in_second[sec] = 0;
-    }
+    unsigned twid = cached_string_width(2, s->input);
+    render_string_cached(2, s->input, WIDTH/2-twid/2, HEIGHT-BARHEIGHT+8, 1.0);
 
     // draw wpm and stuff
     char info_str[100];
 
-    sprintf(info_str, "WPM: %u", cpm/5);
-    render_string(info_str, 5, HEIGHT-BARHEIGHT+5, 0.6);
-    sprintf(info_str, "CPM: %u", cpm);
-    render_string(info_str, 5, HEIGHT-BARHEIGHT+5+20, 0.6);
+    sprintf(info_str, "WPM: %u", s->cpm/5);
+    render_label(&hud_labels[0], info_str, 5, HEIGHT-BARHEIGHT+5, 0.6);
+    sprintf(info_str, "CPM: %u", s->cpm);
+    render_label(&hud_labels[1], info_str, 5, HEIGHT-BARHEIGHT+5+20, 0.6);
 
-    sprintf(info_str, "Words : %u", words);
-    render_string(info_str, WIDTH-140, HEIGHT-BARHEIGHT+5, 0.6);
-    sprintf(info_str, "Chars : %u", chars);
-    render_string(info_str, WIDTH-140, HEIGHT-BARHEIGHT+5+20, 0.6);
+    sprintf(info_str, "Words : %u", s->words_typed);
+    render_label(&hud_labels[2], info_str, WIDTH-140, HEIGHT-BARHEIGHT+5, 0.6);
+    sprintf(info_str, "Chars : %u", s->chars);
+    render_label(&hud_labels[3], info_str, WIDTH-140, HEIGHT-BARHEIGHT+5+20, 0.6);
 
-    return 1;
+    perf_end(PERF_HUD);
 }
 
-void game_render_scores(SDL_Texture** rows) {
+void game_render_scores(const struct game_snapshot* s, SDL_Texture** rows) {
 
     char buf[100];
 
-    Uint32 survived = SDL_GetTicks() - round_start;
+    Uint32 survived = s->survived;
 
     unsigned hours = 0, minutes = 0, seconds = 0;
     if (survived >= 3600000) {hours = survived / 3600000; survived %= 36000000; }
@@ -273,20 +593,63 @@ void game_render_scores(SDL_Texture** rows) {
     if (survived >= 1000) {seconds = survived / 1000; }
 
     sprintf(buf, "Time survived : %02u:%02u:%02u", hours, minutes, seconds);
-    rows[0] = string_cache(buf, (SDL_Color){200, 200, 255, 255});
+    rows[0] = string_cache(buf, (SDL_Color){200, 200, 255, 255}, 0.5);
+
+    sprintf(buf, "Words : %u", s->words_typed);
+    rows[1] = string_cache(buf, (SDL_Color){200, 200, 255, 255}, 0.5);
+
+    sprintf(buf, "Chars : %u", s->chars);
+    rows[2] = string_cache(buf, (SDL_Color){200, 200, 255, 255}, 0.5);
+
+    sprintf(buf, "Best WPM : %u", s->cpm_best/5);
+    rows[3] = string_cache(buf, (SDL_Color){200, 200, 255, 255}, 0.5);
+
+    sprintf(buf, "Best CPM : %u", s->cpm_best);
+    rows[4] = string_cache(buf, (SDL_Color){200, 200, 255, 255}, 0.5);
 
-    sprintf(buf, "Words : %u", words);
-    rows[1] = string_cache(buf, (SDL_Color){200, 200, 255, 255});
+    sprintf(buf, "Accuracy : %.1f%%", s->chars == 0 ? 0 : (double)s->chars/(s->chars+s->backspaces)*100.0);
+    rows[5] = string_cache(buf, (SDL_Color){200, 200, 255, 255}, 0.5);
+}
+
+void game_score(const struct game* g, unsigned* words_out, unsigned* chars_out, unsigned* cpm_best_out) {
+    *words_out = g->words;
+    *chars_out = g->chars;
+    *cpm_best_out = g->cpm_best;
+}
+
+void game_set_seed(struct game* g, unsigned seed) {
+    g->seed = seed;
+}
+
+void game_set_words(size_t count) {
+    stream_size = count;
+}
+
+void game_set_window(size_t slots) {
+    window_slots = slots;
+}
+
+void game_set_adaptive(_Bool on) {
+    adaptive = on;
+}
+
+_Bool game_adaptive() {
+    return adaptive;
+}
 
-    sprintf(buf, "Chars : %u", chars);
-    rows[2] = string_cache(buf, (SDL_Color){200, 200, 255, 255});
+void game_set_corpus(const char* filename, size_t words) {
+    corpus_file = filename;
+    if (words) corpus_words = words;
+}
 
-    sprintf(buf, "Best WPM : %u", cpm_best/5);
-    rows[3] = string_cache(buf, (SDL_Color){200, 200, 255, 255});
+unsigned game_tick(const struct game* g) {
+    return g->time / TICK_MS;
+}
 
-    sprintf(buf, "Best CPM : %u", cpm_best);
-    rows[4] = string_cache(buf, (SDL_Color){200, 200, 255, 255});
+size_t game_stream_size() {
+    return stream_size;
+}
 
-    sprintf(buf, "Accuracy : %.1f%%", chars == 0 ? 0 : (double)chars/(chars+backspaces)*100.0);
-    rows[5] = string_cache(buf, (SDL_Color){200, 200, 255, 255});
+size_t game_dict_size() {
+    return dict.size;
 }
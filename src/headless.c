@@ -0,0 +1,579 @@
+#include "headless.h"
+#include "game.h"
+#include "text.h"
+#include "perf.h"
+#include "replay.h"
+#include "background.h"
+#include "lockstep.h"
+#include "utf8.h"
+
+#include <stdio.h> // printf
+#include <stdlib.h> // strtoul, qsort
+#include <string.h> // strcmp, strlen, memset
+
+#include <SDL.h>
+
+extern SDL_Renderer* ren;
+extern const int WIDTH, HEIGHT, BARHEIGHT;
+
+// The simulated time, every frame simulates exactly one tick
+static Uint32 sim_time = 0;
+
+// The player of the single rounds, the races have their own
+static struct game game;
+// What gets drawn of it, the window hands it over from the simulation thread, here it's copied in place
+static struct game_snapshot snapshot;
+
+// The most players a race can have
+#define    RACE_PLAYERS 64
+
+// Count the allocations made through SDL (surfaces, textures, fonts...)
+static SDL_malloc_func real_malloc;
+static SDL_calloc_func real_calloc;
+static SDL_realloc_func real_realloc;
+static SDL_free_func real_free;
+static unsigned long long allocations = 0;
+
+static void* count_malloc(size_t size) { allocations++; return real_malloc(size); }
+static void* count_calloc(size_t num, size_t size) { allocations++; return real_calloc(num, size); }
+static void* count_realloc(void* mem, size_t size) { allocations++; return real_realloc(mem, size); }
+static void count_free(void* mem) { real_free(mem); }
+
+static int cmp_double(const void* a, const void* b) {
+    double da = *(const double*)a, db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+// The typist's inputs are recorded into this, if given
+static struct replay* recording = NULL;
+
+// The scripted typist always types the rightmost visible word, one key at a time. Returns how many
+// characters to erase before the key, the key is empty if there's nothing to type
+static size_t typist_key(const struct game* g, char key[UTF8_MAX+1]) {
+    memset(key, 0, UTF8_MAX+1);
+
+    const char* target = game_target(g);
+    if (!target) return 0;
+
+    const char* input = game_input(g);
+    size_t len = strlen(input), erase = 0;
+
+    // The input does not lead to the target anymore, erase it first, letter by letter
+    if (strncmp(input, target, len)) {
+        erase = utf8_length(input);
+        len = 0;
+    }
+
+    // Both are lowercase already, so the input ends where a letter of the target starts
+    const char* next = target + len;
+    if (*next) utf8_encode(utf8_next(&next), key);
+    return erase;
+}
+
+static void typist_play(struct game* g) {
+    char key[UTF8_MAX+1];
+    size_t erase = typist_key(g, key);
+
+    if (erase) {
+        game_input_delete(g, erase);
+        if (recording) replay_delete(recording, game_tick(g), erase);
+    }
+    if (key[0]) {
+        game_textinput(g, key);
+        if (recording) replay_text(recording, game_tick(g), key);
+    }
+}
+
+struct run_result {
+    unsigned frames;
+    _Bool alive;
+    double seconds; // wall time of the whole run
+    double median_ms, p99_ms, max_ms; // frame times
+    double allocations; // per frame
+};
+
+// Plays one round, the game has to be created already. The inputs come from the replay if given,
+// otherwise from the typist
+static _Bool run(struct game* g, unsigned seed, unsigned cpm, unsigned frames, struct replay* replay,
+                 struct run_result* r) {
+
+    double* frame_ms = malloc(frames * sizeof(double));
+    if (!frame_ms) return 0;
+
+    sim_time = 0;
+    game_set_seed(g, seed);
+    if (recording) replay_begin(recording, seed, game_stream_size(), game_dict_size());
+    if (replay) replay_rewind(replay);
+    game_start(g);
+    perf_reset();
+
+    const Uint32 key_ms = 60000 / cpm;
+    Uint32 next_key = key_ms;
+
+    const double freq = (double)SDL_GetPerformanceFrequency();
+    unsigned long long start_allocations = allocations;
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    unsigned frame = 0;
+    _Bool alive = 1;
+    while (frame < frames && alive) {
+
+        sim_time += TICK_MS;
+        if (replay)
+            replay_apply(replay, g);
+        else
+            for (; next_key <= sim_time; next_key += key_ms)
+                typist_play(g);
+
+        perf_frame_begin();
+        Uint64 t = SDL_GetPerformanceCounter();
+
+        perf_begin(PERF_UPDATE);
+        alive = game_update(g);
+        game_snapshot(g, &snapshot);
+        perf_end(PERF_UPDATE);
+
+        perf_begin(PERF_BACKGROUND);
+        if (!background_opaque()) {
+            SDL_SetRenderDrawColor(ren, 0, 0, 0, 255);
+            SDL_RenderClear(ren);
+            perf.draw_calls++;
+        }
+        background_draw(sim_time);
+        perf_end(PERF_BACKGROUND);
+
+        game_draw(&snapshot, 1.0);
+
+        perf_begin(PERF_PRESENT);
+        SDL_RenderPresent(ren);
+        perf_end(PERF_PRESENT);
+        perf_frame_end();
+
+        frame_ms[frame++] = (SDL_GetPerformanceCounter() - t) * 1000.0 / freq;
+    }
+
+    r->seconds = (SDL_GetPerformanceCounter() - start) / freq;
+    if (recording) replay_end(recording, g);
+    r->allocations = (double)(allocations - start_allocations) / frame;
+    r->frames = frame;
+    r->alive = alive;
+
+    qsort(frame_ms, frame, sizeof(double), cmp_double);
+    r->median_ms = frame_ms[frame/2];
+    r->p99_ms = frame_ms[frame*99/100];
+    r->max_ms = frame_ms[frame-1];
+
+    free(frame_ms);
+    return 1;
+}
+
+// A race over the loopback, every typist is a client of its own that simulates every player's game.
+// The typists are spread from half to one and a half times the given CPM. Only the first client
+// draws, its own game is the one on the screen
+static _Bool race(size_t players, unsigned seed, unsigned cpm, unsigned frames) {
+
+    _Bool ok = 0, finished = 0;
+    struct lockstep_host host = {0};
+    struct lockstep_client* clients = calloc(players, sizeof(struct lockstep_client));
+    struct game* games = calloc(players * players, sizeof(struct game)); // client c's game of player p is at c*players + p
+    _Bool* alive = calloc(players * players, sizeof(_Bool));
+    uint32_t* done = calloc(players, sizeof(uint32_t)); // the ticks each client has simulated
+    Uint32* key_ms = malloc(players * sizeof(Uint32)), *next_key = malloc(players * sizeof(Uint32));
+    unsigned* lost_at = calloc(players, sizeof(unsigned));
+    double* client_us = malloc(frames * sizeof(double)), *relay_us = malloc(frames * sizeof(double));
+    size_t created = 0;
+
+    if (!clients || !games || !alive || !done || !key_ms || !next_key || !lost_at || !client_us || !relay_us ||
+        !lockstep_host_init(&host, players))
+        goto done;
+
+    for (size_t c = 0; c < players; c++)
+        if (!lockstep_join(&clients[c], &host, c)) goto done;
+
+    for (size_t p = 0; p < players; p++) {
+        unsigned player_cpm = players > 1 ? cpm/2 + cpm * p / (players-1) : cpm;
+        key_ms[p] = next_key[p] = 60000 / (player_cpm ? player_cpm : 1);
+    }
+
+    // The default CPM windows would take most of the memory of players squared games, but a typist
+    // finishes at most one word per key, so a window only needs a slot for every key of the last minute
+    Uint32 fastest = key_ms[players-1] > TICK_MS ? key_ms[players-1] : TICK_MS;
+    if (STATS_SPAN / fastest + 1 < STATS_SLOTS)
+        game_set_window(STATS_SPAN / fastest + 1);
+
+    for (; created < players * players; created++) {
+        struct game* g = &games[created];
+        if (!game_create(g)) goto done;
+
+        g->visible = created == 0;
+        game_set_seed(g, seed);
+        game_start(g);
+        alive[created] = 1;
+    }
+
+    perf_reset();
+    sim_time = 0;
+
+    const double freq = (double)SDL_GetPerformanceFrequency();
+    unsigned tick = 0;
+    size_t playing = players;
+    for (; tick < frames && playing > 0; tick++) {
+        sim_time += TICK_MS;
+
+        // Everyone types into their own client, looking at their own game there
+        for (size_t p = 0; p < players; p++) {
+            const struct game* own = &games[p*players + p];
+
+            for (; alive[p*players + p] && next_key[p] <= sim_time; next_key[p] += key_ms[p]) {
+                char key[UTF8_MAX+1];
+                size_t erase = typist_key(own, key);
+                if (erase) lockstep_delete(&clients[p], tick, erase);
+                if (key[0]) lockstep_text(&clients[p], tick, key);
+            }
+
+            if (!lockstep_flush(&clients[p], tick)) goto done;
+        }
+
+        Uint64 t = SDL_GetPerformanceCounter();
+        if (!lockstep_host_relay(&host)) goto done;
+        relay_us[tick] = (SDL_GetPerformanceCounter() - t) * 1e6 / freq;
+
+        for (size_t c = 0; c < players; c++) {
+            t = SDL_GetPerformanceCounter();
+            if (!lockstep_poll(&clients[c])) goto done;
+
+            // A client that is still waiting for someone's inputs just doesn't advance yet
+            for (; lockstep_ready(&clients[c], done[c]); done[c]++)
+                for (size_t p = 0; p < players; p++) {
+                    struct game* g = &games[c*players + p];
+                    if (!alive[c*players + p]) continue;
+
+                    replay_apply(&clients[c].inputs[p], g);
+                    if (!(alive[c*players + p] = game_update(g)) && c == p) {
+                        lost_at[p] = game_tick(g);
+                        playing--;
+                    }
+                }
+
+            if (c == 0) client_us[tick] = (SDL_GetPerformanceCounter() - t) * 1e6 / freq;
+        }
+
+        // The first client's screen
+        perf_frame_begin();
+        perf_begin(PERF_BACKGROUND);
+        if (!background_opaque()) {
+            SDL_SetRenderDrawColor(ren, 0, 0, 0, 255);
+            SDL_RenderClear(ren);
+            perf.draw_calls++;
+        }
+        background_draw(sim_time);
+        perf_end(PERF_BACKGROUND);
+
+        game_snapshot(&games[0], &snapshot);
+        game_draw(&snapshot, 1.0);
+
+        perf_begin(PERF_PRESENT);
+        SDL_RenderPresent(ren);
+        perf_end(PERF_PRESENT);
+        perf_frame_end();
+    }
+
+    printf("Race of %zu players, seed %u, typists at %u to %u CPM: %u ticks (%.1f simulated seconds)\n",
+           players, seed, players > 1 ? cpm/2 : cpm, players > 1 ? cpm/2 + cpm : cpm, tick, tick * TICK_MS / 1000.0);
+    printf("%8s %8s %8s %8s %10s %10s\n", "player", "CPM", "words", "chars", "best CPM", "lost at");
+
+    // Every client has to have come to the same result for every game
+    _Bool agree = 1;
+    for (size_t p = 0; p < players; p++) {
+        unsigned words, chars, cpm_best;
+        game_score(&games[p*players + p], &words, &chars, &cpm_best);
+
+        for (size_t c = 0; c < players; c++) {
+            unsigned w, ch, best;
+            game_score(&games[c*players + p], &w, &ch, &best);
+            if (w != words || ch != chars || best != cpm_best ||
+                game_tick(&games[c*players + p]) != game_tick(&games[p*players + p]))
+                agree = 0;
+        }
+
+        char lost[16] = "-";
+        if (lost_at[p]) snprintf(lost, sizeof(lost), "%u", lost_at[p]);
+        printf("%8zu %8u %8u %8u %10u %10s\n", p, 60000 / key_ms[p], words, chars, cpm_best, lost);
+    }
+    printf(agree ? "All the clients agree on every game\n" : "The clients disagree about the games\n");
+
+    double seconds = tick * TICK_MS / 1000.0;
+    uint64_t up = 0, down = 0, down_max = 0;
+    for (size_t c = 0; c < players; c++) {
+        up += host.up[c].bytes;
+        down += host.down[c].bytes;
+        if (host.down[c].bytes > down_max) down_max = host.down[c].bytes;
+    }
+    printf("Bandwidth per client: %.0f B/s up and %.0f B/s down on average, %.0f B/s down at most\n",
+           up / seconds / players, down / seconds / players, down_max / seconds);
+
+    qsort(client_us, tick, sizeof(double), cmp_double);
+    qsort(relay_us, tick, sizeof(double), cmp_double);
+    printf("Client CPU per tick (all %zu games): median %.1f us, 99th percentile %.1f us, max %.1f us\n",
+           players, client_us[tick/2], client_us[tick*99/100], client_us[tick-1]);
+    printf("Host relay per tick: median %.1f us, 99th percentile %.1f us\n", relay_us[tick/2], relay_us[tick*99/100]);
+
+    ok = agree;
+    finished = 1;
+
+done:
+    if (!finished)
+        fprintf(stderr, "The race failed, out of memory or the messages were broken\n");
+
+    for (size_t i = 0; i < created; i++)
+        game_destroy(&games[i]);
+    for (size_t c = 0; clients && c < players; c++)
+        lockstep_leave(&clients[c]);
+    lockstep_host_destroy(&host);
+
+    free(clients);
+    free(games);
+    free(alive);
+    free(done);
+    free(key_ms);
+    free(next_key);
+    free(lost_at);
+    free(client_us);
+    free(relay_us);
+    return ok;
+}
+
+// Records the second round of a session, then plays it back on a fresh game and once more on the same one,
+// like the windowed game replays it. A round must not depend on the rounds played before it
+static _Bool replay_check(unsigned seed, unsigned cpm, unsigned frames) {
+    struct replay rec = {0};
+    struct run_result r;
+
+    // The first round leaves its word pool, matcher and speed behind
+    _Bool ok = run(&game, seed, cpm, frames, NULL, &r);
+    recording = &rec;
+    ok = ok && run(&game, seed + 1, cpm, frames, NULL, &r);
+    recording = NULL;
+
+    for (int fresh = 1; ok && fresh >= 0; fresh--) {
+        if (fresh) {
+            game_destroy(&game);
+            if (!game_create(&game)) break;
+            game.visible = 1;
+        }
+
+        ok = run(&game, rec.seed, cpm, rec.ticks, &rec, &r) && replay_verify(&rec, &game);
+        printf("The second round replayed on %s game: %s\n", fresh ? "a fresh" : "the same",
+               ok ? "matches the recorded score" : "does not match the recorded score");
+    }
+
+    replay_destroy(&rec);
+    return ok;
+}
+
+int headless_main(int argc, char* argv[]) {
+
+    unsigned seed = 1, cpm = 300, frames = 6000, words = 16;
+    _Bool scaling = 0, check = 0;
+    unsigned players = 0;
+    const char* trace_file = NULL;
+    const char* record_file = NULL, *replay_file = NULL;
+    const char* background_file = "res/bg.bmp";
+    _Bool background_tiled = 0;
+
+    for (int i = 0; i < argc; i++) {
+        if (i+1 < argc && !strcmp(argv[i], "--seed"))
+            seed = strtoul(argv[++i], NULL, 10);
+        else if (i+1 < argc && !strcmp(argv[i], "--cpm"))
+            cpm = strtoul(argv[++i], NULL, 10);
+        else if (i+1 < argc && !strcmp(argv[i], "--frames"))
+            frames = strtoul(argv[++i], NULL, 10);
+        else if (i+1 < argc && !strcmp(argv[i], "--words"))
+            words = strtoul(argv[++i], NULL, 10);
+        else if (i+1 < argc && !strcmp(argv[i], "--trace"))
+            trace_file = argv[++i];
+        else if (i+1 < argc && !strcmp(argv[i], "--record"))
+            record_file = argv[++i];
+        else if (i+1 < argc && !strcmp(argv[i], "--replay"))
+            replay_file = argv[++i];
+        else if (i+1 < argc && !strcmp(argv[i], "--background"))
+            background_file = argv[++i];
+        else if (!strcmp(argv[i], "--tiled"))
+            background_tiled = 1;
+        else if (!strcmp(argv[i], "--scaling"))
+            scaling = 1;
+        else if (!strcmp(argv[i], "--replay-check"))
+            check = 1;
+        else if (!strcmp(argv[i], "--adaptive"))
+            game_set_adaptive(1);
+        else if (i+1 < argc && !strcmp(argv[i], "--race"))
+            players = strtoul(argv[++i], NULL, 10);
+        else {
+            fprintf(stderr, "Usage: --headless [--seed N] [--cpm N] [--frames N] [--words N] [--scaling] [--trace file]\n"
+                            "       [--record file] [--replay file] [--background file|procedural] [--tiled] [--race players]\n"
+                            "       [--adaptive] [--replay-check]\n");
+            return 1;
+        }
+    }
+
+    if (seed == 0 || cpm == 0 || frames == 0 || words == 0) {
+        fprintf(stderr, "The seed, CPM, frame and word counts have to be positive\n");
+        return 1;
+    }
+
+    // Every client simulates every game, so this is players squared games in one process
+    if (players > RACE_PLAYERS) {
+        fprintf(stderr, "A race can have at most %d players\n", RACE_PLAYERS);
+        return 1;
+    }
+    if (players && (record_file || replay_file || scaling)) {
+        fprintf(stderr, "A race can't be recorded, replayed or scaled\n");
+        return 1;
+    }
+    if (check && (players || record_file || replay_file || scaling)) {
+        fprintf(stderr, "The replay check plays its own rounds\n");
+        return 1;
+    }
+
+    // The replay brings its own seed and stream size, and it runs to the tick it was lost at
+    struct replay rec = {0}, rep = {0};
+    if (record_file) recording = &rec;
+    if (replay_file) {
+        if (!replay_load(&rep, replay_file)) {
+            fprintf(stderr, "Failed to load the replay %s\n", replay_file);
+            return 1;
+        }
+        seed = rep.seed;
+        words = rep.stream_size;
+        game_set_adaptive(rep.adaptive);
+        frames = rep.ticks;
+        scaling = 0;
+    }
+
+    SDL_GetMemoryFunctions(&real_malloc, &real_calloc, &real_realloc, &real_free);
+    SDL_SetMemoryFunctions(count_malloc, count_calloc, count_realloc, count_free);
+
+    // No display is needed, everything is rendered into an offscreen surface
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+    if (SDL_Init(SDL_INIT_VIDEO)) {
+        fprintf(stderr, "SDL2 failed to initialize: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    SDL_Surface* target = SDL_CreateRGBSurfaceWithFormat(0, WIDTH, HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (!target || !(ren = SDL_CreateSoftwareRenderer(target))) {
+        fprintf(stderr, "Failed to create the software renderer: %s\n", SDL_GetError());
+        return 1;
+    }
+    SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_BLEND);
+
+    // The audio is not opened, so the sound effects are simply skipped
+    if (!font_init()) return 1;
+
+    if (trace_file && !perf_trace_open(trace_file)) {
+        fprintf(stderr, "Failed to open the trace file %s\n", trace_file);
+        return 1;
+    }
+
+    background_configure(background_file, background_tiled, 1);
+    background_upload(background_load());
+
+    struct run_result r;
+    _Bool verified = 1;
+
+    if (players) {
+        game_set_words(words);
+        if (!game_init()) return 1;
+
+        verified = race(players, seed, cpm, frames);
+        perf_report(stdout);
+
+        game_destroy(&game);
+        game_dealloc();
+    } else if (check) {
+        game_set_words(words);
+        if (!game_init() || !game_create(&game)) return 1;
+        game.visible = 1;
+
+        verified = replay_check(seed, cpm, frames);
+
+        game_destroy(&game);
+        game_dealloc();
+    } else if (scaling) {
+        // The same round with more and more words, short enough that nobody loses
+        if (frames > 1500) frames = 1500;
+
+        printf("%8s %8s %10s %10s %10s\n", "words", "frames", "median ms", "p99 ms", "max ms");
+
+        for (unsigned count = 16; count <= 16384; count *= 4) {
+            game_set_words(count);
+            if (!game_init() || !game_create(&game)) return 1;
+            game.visible = 1;
+            if (!run(&game, seed, cpm, frames, NULL, &r)) return 1;
+            game_destroy(&game);
+            game_dealloc();
+
+            printf("%8u %8u %10.3f %10.3f %10.3f\n", count, r.frames, r.median_ms, r.p99_ms, r.max_ms);
+        }
+    } else {
+        game_set_words(words);
+        if (!game_init() || !game_create(&game)) return 1;
+        game.visible = 1;
+
+        if (replay_file && rep.dict_size != game_dict_size()) {
+            fprintf(stderr, "The replay was recorded with a different dictionary\n");
+            return 1;
+        }
+
+        if (!run(&game, seed, cpm, frames, replay_file ? &rep : NULL, &r)) return 1;
+
+        unsigned score_words, score_chars, cpm_best;
+        game_score(&game, &score_words, &score_chars, &cpm_best);
+
+        printf("Seed %u, %u words, typist at %u CPM: %s after %u frames (%.1f simulated seconds)\n",
+               seed, words, cpm, r.alive ? "survived" : "lost", r.frames, r.frames * TICK_MS / 1000.0);
+        printf("Words: %u, chars: %u, best CPM: %u\n", score_words, score_chars, cpm_best);
+        if (game_adaptive()) {
+            printf("Slowest bigrams:");
+            for (size_t i = 0; i < game.weak_count; i++) {
+                size_t b = game.weak[i];
+                printf(" %c%c (%u ms)", 'a' + (int)(b / 26), 'a' + (int)(b % 26), game.bigram_ms[b] / game.bigram_count[b]);
+            }
+            printf("%s\n", game.weak_count ? "" : " none measured yet");
+        }
+        if (replay_file) {
+            verified = replay_verify(&rep, &game);
+            if (verified)
+                printf("The replay matches the recorded score\n");
+            else
+                printf("The replay does not match the recorded score (%u words, %u chars, best CPM %u after %u ticks)\n",
+                       rep.words, rep.chars, rep.cpm_best, rep.ticks);
+        }
+        if (record_file && !replay_save(&rec, record_file)) {
+            fprintf(stderr, "Failed to save the replay %s\n", record_file);
+            verified = 0;
+        }
+        printf("Frames per second: %.1f\n", r.frames / r.seconds);
+        printf("Frame time: median %.3f ms, 99th percentile %.3f ms, max %.3f ms\n",
+               r.median_ms, r.p99_ms, r.max_ms);
+        printf("SDL allocations per frame: %.2f\n", r.allocations);
+        perf_report(stdout);
+
+        game_destroy(&game);
+        game_dealloc();
+    }
+
+    background_dealloc();
+    game_snapshot_destroy(&snapshot);
+    replay_destroy(&rec);
+    replay_destroy(&rep);
+    perf_dealloc();
+    font_dealloc();
+
+    SDL_DestroyRenderer(ren);
+    SDL_FreeSurface(target);
+    SDL_Quit();
+
+    // A replay with a different outcome fails, so replays can be used as regression tests
+    return !verified;
+}
@@ -0,0 +1,91 @@
+#include "loader.h"
+#include "audio.h"
+#include "background.h"
+#include "game.h"
+#include "text.h"
+
+#include <stdio.h> // fprintf
+
+static struct {
+    SDL_Thread* thread;
+    SDL_atomic_t done;
+    _Bool joined;
+    _Bool ok;
+} jobs[LOAD_JOBS];
+
+static SDL_Surface* bg_surf;
+
+static int load_words(void* data) {
+    (void)data;
+    // The dictionary widths need the glyphs
+    jobs[LOAD_WORDS].ok = font_load() && game_init();
+    SDL_AtomicSet(&jobs[LOAD_WORDS].done, 1);
+    return 0;
+}
+
+static int load_sounds(void* data) {
+    (void)data;
+    audio_load();
+    jobs[LOAD_SOUNDS].ok = 1;
+    SDL_AtomicSet(&jobs[LOAD_SOUNDS].done, 1);
+    return 0;
+}
+
+static int load_background(void* data) {
+    (void)data;
+    bg_surf = background_load();
+    jobs[LOAD_BACKGROUND].ok = bg_surf != NULL;
+    SDL_AtomicSet(&jobs[LOAD_BACKGROUND].done, 1);
+    return 0;
+}
+
+_Bool loader_start() {
+    static const SDL_ThreadFunction run[LOAD_JOBS] = {
+        [LOAD_WORDS] = load_words,
+        [LOAD_SOUNDS] = load_sounds,
+        [LOAD_BACKGROUND] = load_background
+    };
+    static const char* names[LOAD_JOBS] = {"load_words", "load_sounds", "load_background"};
+
+    for (size_t i = 0; i < LOAD_JOBS; i++)
+        if (!(jobs[i].thread = SDL_CreateThread(run[i], names[i], NULL))) {
+            fprintf(stderr, "Failed to start the loading: %s\n", SDL_GetError());
+            loader_wait();
+            return 0;
+        }
+
+    return 1;
+}
+
+_Bool loader_done(enum load_job job) {
+    if (jobs[job].joined) return 1;
+    if (!SDL_AtomicGet(&jobs[job].done)) return 0;
+
+    // Joining makes everything the job wrote visible here
+    SDL_WaitThread(jobs[job].thread, NULL);
+    jobs[job].thread = NULL;
+    jobs[job].joined = 1;
+    return 1;
+}
+
+_Bool loader_ok(enum load_job job) {
+    return jobs[job].joined && jobs[job].ok;
+}
+
+SDL_Surface* loader_background() {
+    SDL_Surface* surf = bg_surf;
+    bg_surf = NULL;
+    return surf;
+}
+
+void loader_wait() {
+    for (size_t i = 0; i < LOAD_JOBS; i++)
+        if (jobs[i].thread) {
+            SDL_WaitThread(jobs[i].thread, NULL);
+            jobs[i].thread = NULL;
+            jobs[i].joined = 1;
+        }
+
+    SDL_FreeSurface(bg_surf);
+    bg_surf = NULL;
+}
@@ -0,0 +1,270 @@
+#include "lockstep.h"
+
+#include <stdlib.h> // calloc, realloc
+#include <string.h> // memcpy, memmove, memset
+
+static _Bool link_reserve(struct lockstep_link* l, size_t n) {
+    if (l->size + n <= l->cap) return 1;
+
+    size_t cap = l->cap ? l->cap * 2 : 256;
+    while (cap < l->size + n) cap *= 2;
+
+    uint8_t* data = realloc(l->data, cap);
+    if (!data) return 0;
+
+    l->data = data;
+    l->cap = cap;
+    return 1;
+}
+
+static void link_destroy(struct lockstep_link* l) {
+    free(l->data);
+    memset(l, 0, sizeof(*l));
+}
+
+// The read bytes are dropped, the start of a message that hasn't fully arrived moves to the front
+static void link_consumed(struct lockstep_link* l) {
+    if (l->read && l->read < l->size)
+        memmove(l->data, l->data + l->read, l->size - l->read);
+    l->size -= l->read;
+    l->read = 0;
+}
+
+static _Bool put_varint(struct lockstep_link* l, uint32_t v) {
+    if (!link_reserve(l, 5)) return 0;
+
+    size_t start = l->size;
+    for (; v >= 0x80; v >>= 7)
+        l->data[l->size++] = (v & 0x7f) | 0x80;
+    l->data[l->size++] = v;
+    l->bytes += l->size - start;
+    return 1;
+}
+
+static _Bool put_bytes(struct lockstep_link* l, const uint8_t* data, size_t size) {
+    if (!put_varint(l, size) || !link_reserve(l, size)) return 0;
+
+    if (size) memcpy(l->data + l->size, data, size);
+    l->size += size;
+    l->bytes += size;
+    return 1;
+}
+
+// A message is read from a cursor, so that one which is cut short can be read again from its start
+// once the rest is there. A stream carries the bytes in any pieces
+enum parse {
+    PARSE_OK,
+    PARSE_SHORT, // the rest hasn't arrived yet
+    PARSE_BAD
+};
+
+static enum parse get_varint(const struct lockstep_link* l, size_t* at, uint32_t* v) {
+    *v = 0;
+    for (unsigned shift = 0; shift < 35; shift += 7) {
+        if (*at >= l->size) return PARSE_SHORT;
+
+        uint8_t b = l->data[(*at)++];
+        *v |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return PARSE_OK;
+    }
+    return PARSE_BAD;
+}
+
+// The bytes stay in the link, they're valid until it's written to
+static enum parse get_bytes(const struct lockstep_link* l, size_t* at, const uint8_t** data, uint32_t* size) {
+    enum parse r = get_varint(l, at, size);
+    if (r != PARSE_OK) return r;
+    if (*size > l->size - *at) return PARSE_SHORT;
+
+    *data = l->data + *at;
+    *at += *size;
+    return PARSE_OK;
+}
+
+_Bool lockstep_host_init(struct lockstep_host* h, size_t players) {
+    memset(h, 0, sizeof(*h));
+    h->players = players;
+
+    h->up = calloc(players, sizeof(struct lockstep_link));
+    h->down = calloc(players, sizeof(struct lockstep_link));
+    h->pending = calloc(players, sizeof(struct lockstep_link));
+    h->promised = calloc(players, sizeof(uint32_t));
+    if (!h->up || !h->down || !h->pending || !h->promised) {
+        lockstep_host_destroy(h);
+        return 0;
+    }
+
+    // Nobody can have typed anything before the delay
+    for (size_t p = 0; p < players; p++)
+        h->promised[p] = LOCKSTEP_DELAY;
+    h->announced = LOCKSTEP_DELAY;
+
+    return 1;
+}
+
+void lockstep_host_destroy(struct lockstep_host* h) {
+    for (size_t p = 0; h->up && h->down && h->pending && p < h->players; p++) {
+        link_destroy(&h->up[p]);
+        link_destroy(&h->down[p]);
+        link_destroy(&h->pending[p]);
+    }
+    free(h->up);
+    free(h->down);
+    free(h->pending);
+    free(h->promised);
+    memset(h, 0, sizeof(*h));
+}
+
+_Bool lockstep_host_relay(struct lockstep_host* h) {
+
+    // Collect the new promises and events
+    _Bool any_events = 0;
+    for (size_t p = 0; p < h->players; p++) {
+        struct lockstep_link* up = &h->up[p];
+
+        while (up->read < up->size) {
+            size_t at = up->read;
+            uint32_t delta, size;
+            const uint8_t* events;
+            enum parse r = get_varint(up, &at, &delta);
+            if (r == PARSE_OK) r = get_bytes(up, &at, &events, &size);
+
+            if (r == PARSE_SHORT) break;
+            if (r == PARSE_BAD) return 0;
+            up->read = at;
+
+            h->promised[p] += delta;
+            if (!link_reserve(&h->pending[p], size)) return 0;
+            if (size) memcpy(h->pending[p].data + h->pending[p].size, events, size);
+            h->pending[p].size += size;
+            any_events |= size > 0;
+        }
+        link_consumed(up);
+    }
+
+    uint32_t known = UINT32_MAX;
+    for (size_t p = 0; p < h->players; p++)
+        if (h->promised[p] < known) known = h->promised[p];
+
+    if (known == h->announced && !any_events)
+        return 1;
+
+    // Every client gets the events of everyone else, its own it has already
+    for (size_t c = 0; c < h->players; c++) {
+        struct lockstep_link* down = &h->down[c];
+        if (!put_varint(down, known - h->announced)) return 0;
+
+        for (size_t p = 0; p < h->players; p++) {
+            if (p == c || h->pending[p].size == 0) continue;
+
+            if (!put_varint(down, p + 1) ||
+                !put_bytes(down, h->pending[p].data, h->pending[p].size))
+                return 0;
+        }
+
+        if (!put_varint(down, 0)) return 0;
+    }
+
+    for (size_t p = 0; p < h->players; p++)
+        h->pending[p].size = 0;
+    h->announced = known;
+
+    return 1;
+}
+
+_Bool lockstep_join(struct lockstep_client* c, struct lockstep_host* h, size_t player) {
+    memset(c, 0, sizeof(*c));
+    if (player >= h->players) return 0;
+
+    c->player = player;
+    c->players = h->players;
+    c->up = &h->up[player];
+    c->down = &h->down[player];
+    c->promised = c->known = LOCKSTEP_DELAY;
+
+    c->inputs = calloc(c->players, sizeof(struct replay));
+    return c->inputs != NULL;
+}
+
+void lockstep_leave(struct lockstep_client* c) {
+    for (size_t p = 0; c->inputs && p < c->players; p++)
+        replay_destroy(&c->inputs[p]);
+    free(c->inputs);
+    replay_destroy(&c->local);
+    memset(c, 0, sizeof(*c));
+}
+
+_Bool lockstep_text(struct lockstep_client* c, uint32_t tick, const char* str) {
+    return replay_text(&c->local, tick + LOCKSTEP_DELAY, str);
+}
+
+_Bool lockstep_delete(struct lockstep_client* c, uint32_t tick, size_t num) {
+    return replay_delete(&c->local, tick + LOCKSTEP_DELAY, num);
+}
+
+_Bool lockstep_flush(struct lockstep_client* c, uint32_t tick) {
+    // Anything typed from now on is played at this tick or later
+    uint32_t promise = tick + LOCKSTEP_DELAY;
+    if (promise < c->promised) promise = c->promised;
+
+    const uint8_t* events = c->local.data;
+    size_t size = c->local.size;
+    if (promise == c->promised && size == 0)
+        return 1;
+
+    if (!put_varint(c->up, promise - c->promised) || !put_bytes(c->up, events, size))
+        return 0;
+
+    // Our own inputs don't come back from the host
+    if (!replay_append(&c->inputs[c->player], events, size))
+        return 0;
+
+    // Only the tick of the last event is needed to record the next ones
+    c->local.size = 0;
+    c->promised = promise;
+    return 1;
+}
+
+// Reads the message of the host at the cursor, the events are only passed on if apply is set
+static enum parse read_relay(struct lockstep_client* c, size_t* at, _Bool apply) {
+    struct lockstep_link* down = c->down;
+
+    uint32_t delta, player;
+    enum parse r = get_varint(down, at, &delta);
+
+    while (r == PARSE_OK) {
+        if ((r = get_varint(down, at, &player)) != PARSE_OK) break;
+        if (player == 0) {
+            if (apply) c->known += delta;
+            break;
+        }
+
+        const uint8_t* events;
+        uint32_t size;
+        if (player > c->players) return PARSE_BAD;
+        if ((r = get_bytes(down, at, &events, &size)) != PARSE_OK) break;
+        if (apply && !replay_append(&c->inputs[player-1], events, size)) return PARSE_BAD;
+    }
+
+    return r;
+}
+
+_Bool lockstep_poll(struct lockstep_client* c) {
+    struct lockstep_link* down = c->down;
+
+    // A message is only played once all of it is there
+    while (down->read < down->size) {
+        size_t at = down->read;
+        enum parse r = read_relay(c, &at, 0);
+
+        if (r == PARSE_SHORT) break;
+        if (r == PARSE_BAD) return 0;
+
+        at = down->read;
+        if (read_relay(c, &at, 1) != PARSE_OK) return 0;
+        down->read = at;
+    }
+    link_consumed(down);
+
+    return 1;
+}
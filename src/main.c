@@ -1,36 +1,76 @@
 #include <SDL.h>
-#include <SDL_mixer.h>
 
 #include <stdio.h> // stderr, fprintf
+#include <stdlib.h> // strtol
+#include <string.h> // strcmp
 
 #include "text.h"
 #include "game.h"
+#include "perf.h"
+#include "headless.h"
+#include "bench.h"
+#include "audio.h"
+#include "replay.h"
+#include "loader.h"
+#include "background.h"
+#include "sim.h"
+#include "compose.h"
 
 SDL_Window* win;
 SDL_Renderer* ren;
 const int WIDTH = 640, HEIGHT = 360, BARHEIGHT = 50;
 
-static SDL_Texture* load_texture(const char* filename) {
-    SDL_Surface* surf = SDL_LoadBMP(filename);
-    if (!surf) return NULL;
-    SDL_Texture* tex = SDL_CreateTextureFromSurface(ren, surf);
-    SDL_FreeSurface(surf);
-    return tex;
+// The one player of the windowed game
+static struct game player;
+// The player's game runs on the simulation thread
+static struct sim sim;
+
+// A texture with its logical size, queried once when it is created and never while drawing
+struct sized_texture {
+    SDL_Texture* tex;
+    float w, h;
+};
+
+static struct sized_texture sized(SDL_Texture* tex) {
+    struct sized_texture st = {tex, 0, 0};
+    if (tex) {
+        int w, h;
+        SDL_QueryTexture(tex, NULL, NULL, &w, &h);
+        perf.texture_queries++;
+
+        // The text is rasterized for the pixels of the window
+        st.w = w / text_pixel_scale();
+        st.h = h / text_pixel_scale();
+    }
+    return st;
 }
 
 // Render texture with the anchor point in the middle instead of the top left
-static void render_middle(SDL_Texture* tex, int x, int y, double scale) {
-    SDL_Rect dstr;
-    if (SDL_QueryTexture(tex, NULL, NULL, &dstr.w, &dstr.h))
-        return;
+static void render_middle(struct sized_texture st, int x, int y) {
+    if (!st.tex) return;
+
+    SDL_RenderCopyF(ren, st.tex, NULL, &(SDL_FRect){x-st.w/2, y-st.h/2, st.w, st.h});
+    perf.draw_calls++;
+}
+
+// The start and lost screen texts
+static struct sized_texture screen_text(const char* str, double scale) {
+    return sized(string_cache(str, (SDL_Color){200, 200, 255, 255}, scale));
+}
 
-    dstr.w = (int)(dstr.w*scale);
-    dstr.h = (int)(dstr.h*scale);
+// The window can have any size, the game is laid out in WIDTH x HEIGHT units scaled to fit it
+// The letterbox bars are outside of the background, they have to be cleared
+static _Bool letterboxed = 0;
 
-    dstr.x = x-dstr.w/2;
-    dstr.y = y-dstr.h/2;
+static void update_pixel_scale() {
+    int w, h;
+    if (SDL_GetRendererOutputSize(ren, &w, &h)) return;
 
-    SDL_RenderCopy(ren, tex, NULL, &dstr);
+    float sx = (float)w / WIDTH, sy = (float)h / HEIGHT;
+    float scale = sx < sy ? sx : sy;
+    text_set_pixel_scale(scale);
+
+    letterboxed = (int)(WIDTH * scale + 0.5f) < w-1 || (int)(HEIGHT * scale + 0.5f) < h-1;
 }
 
 static void set_icon(SDL_Surface* icon) {
@@ -65,8 +105,78 @@ static void set_icon(SDL_Surface* icon) {
 
 int main(int argc, char *argv[]) {
 
-    // The compiler complains about us not using the variables
-    (void)argc; (void)argv;
+    // Benchmarking runs don't open a window at all
+    if (argc > 1 && !strcmp(argv[1], "--headless"))
+        return headless_main(argc-2, argv+2);
+    if (argc > 1 && !strcmp(argv[1], "--bench"))
+        return bench_main(argc-2, argv+2);
+
+    // The startup times are measured from here
+    const Uint64 launch = SDL_GetPerformanceCounter();
+
+    // The frames are paced by vsync, unless a frame cap is given (0 means uncapped)
+    int fps_cap = -1;
+    int audio_buffer = AUDIO_BUFFER_DEFAULT;
+    const char* trace_file = NULL;
+    const char* record_file = NULL, *replay_file = NULL;
+    const char* corpus_file = NULL;
+    long corpus_words = 0;
+    const char* background_file = "res/bg.bmp";
+    _Bool background_tiled = 0;
+    enum compose_mode compose_mode = COMPOSE_AUTO;
+    for (int i = 1; i < argc; i++)
+        if (i+1 < argc && !strcmp(argv[i], "--fps"))
+            fps_cap = (int)strtol(argv[++i], NULL, 10);
+        else if (i+1 < argc && !strcmp(argv[i], "--trace"))
+            trace_file = argv[++i];
+        else if (i+1 < argc && !strcmp(argv[i], "--audio-buffer"))
+            audio_buffer = (int)strtol(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--low-latency"))
+            audio_buffer = AUDIO_BUFFER_LOW;
+        else if (i+1 < argc && !strcmp(argv[i], "--record"))
+            record_file = argv[++i];
+        else if (i+1 < argc && !strcmp(argv[i], "--replay"))
+            replay_file = argv[++i];
+        else if (i+1 < argc && !strcmp(argv[i], "--background"))
+            background_file = argv[++i];
+        else if (!strcmp(argv[i], "--tiled"))
+            background_tiled = 1;
+        else if (!strcmp(argv[i], "--compose"))
+            compose_mode = COMPOSE_ON;
+        else if (!strcmp(argv[i], "--no-compose"))
+            compose_mode = COMPOSE_OFF;
+        else if (i+1 < argc && !strcmp(argv[i], "--corpus"))
+            corpus_file = argv[++i];
+        else if (i+1 < argc && !strcmp(argv[i], "--corpus-words")) {
+            long words = strtol(argv[++i], NULL, 10);
+            if (words > 0) corpus_words = words;
+        }
+        else if (!strcmp(argv[i], "--adaptive"))
+            game_set_adaptive(1);
+        else if (i+1 < argc && !strcmp(argv[i], "--words")) {
+            long words = strtol(argv[++i], NULL, 10);
+            if (words > 0) game_set_words(words);
+        }
+
+    if (corpus_file) {
+        game_set_corpus(corpus_file, corpus_words);
+        if (record_file || replay_file)
+            fprintf(stderr, "The words of a streamed corpus change all the time, the replays won't match\n");
+    }
+
+    // The replay decides the stream size, it has to be known before game_init
+    struct replay rec = {0}, rep = {0};
+    if (replay_file) {
+        if (!replay_load(&rep, replay_file)) {
+            fprintf(stderr, "Failed to load the replay %s\n", replay_file);
+            exit(1);
+        }
+        game_set_words(rep.stream_size);
+        game_set_adaptive(rep.adaptive);
+    }
+
+    if (fps_cap < 0)
+        SDL_SetHint(SDL_HINT_RENDER_VSYNC, "1");
 
     // Init SDL
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO)) {
@@ -75,17 +185,34 @@ int main(int argc, char *argv[]) {
     }
 
     // Create the window with the renderer
-    if (SDL_CreateWindowAndRenderer(WIDTH, HEIGHT, SDL_WINDOW_SHOWN, &win, &ren)) {
+    if (SDL_CreateWindowAndRenderer(WIDTH, HEIGHT, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI, &win, &ren)) {
         fprintf(stderr, "Failed to create a window: %s\n", SDL_GetError());
         exit(1);
     }
 
+    // Everything is drawn in WIDTH x HEIGHT units, letterboxed into the window
+    SDL_RenderSetLogicalSize(ren, WIDTH, HEIGHT);
+    update_pixel_scale();
+
+    // Not all drivers can do vsync, don't let the loop spin freely in that case
+    SDL_RendererInfo info;
+    if (fps_cap < 0 && (SDL_GetRendererInfo(ren, &info) || !(info.flags & SDL_RENDERER_PRESENTVSYNC))) {
+        fprintf(stderr, "Vsync is not available, capping the frame rate at 120 FPS\n");
+        fps_cap = 120;
+    }
+
     // Set the transparent blend mode
     if (SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_BLEND)) {
         fprintf(stderr, "Failed to set the blend mode: %s\n", SDL_GetError());
         exit(1);
     }
 
+    // Without acceleration, the frames are composited on the CPU. It has to be decided
+    // before the atlas and the background are uploaded
+    compose_init(compose_mode);
+    if (compose_enabled())
+        printf("Compositing the frames on the CPU with the %s kernels\n", compose_isa_name(compose_isa()));
+
     // Set the title
     SDL_SetWindowTitle(win, "Wordstream - A typing game");
     
@@ -94,108 +221,249 @@ int main(int argc, char *argv[]) {
 
     // Initialize SDL_Mixer
     // Notice that we don't quit when it fails, it is optional
-    if (Mix_OpenAudio(MIX_DEFAULT_FREQUENCY, MIX_DEFAULT_FORMAT, 1, 4096))
-        fprintf(stderr, "SDL_Mixer failed to initialize : %s\n", Mix_GetError());
+    if (audio_buffer <= 0) audio_buffer = AUDIO_BUFFER_DEFAULT;
+    audio_init(audio_buffer);
+
+    // The fonts, the game, the sounds and the background are loaded on other threads
+    // while the loading screen is up already
+    background_configure(background_file, background_tiled, text_pixel_scale());
+    if (!loader_start()) exit(1);
 
-    // Initialise the game and fonts, fonts rather first
-    if (!font_init() | !game_init()) exit(1);
+    if (trace_file && !perf_trace_open(trace_file))
+        fprintf(stderr, "Failed to open the trace file %s\n", trace_file);
 
     // Cache some textures
-    SDL_Texture* start_tex, *lost_tex; 
-    SDL_Texture* bg;
+    struct sized_texture start_tex = {NULL, 0, 0}, lost_tex = {NULL, 0, 0};
 
     // This will be used to display the scores on the losing screen
-    SDL_Texture* lost_info_tex[NUM_SCORES];
+    SDL_Texture* lost_info_tex[NUM_SCORES] = {NULL};
+    struct sized_texture lost_info[NUM_SCORES] = {{NULL, 0, 0}};
 
-    // Cache the starting screen
-    start_tex = string_cache("Press SPACE to play", (SDL_Color){200, 200, 255, 255});
+    // The steps of the loading that happen on this thread, the textures go up one per frame
+    // so that the loading screen never freezes
+    enum { LOAD_STEPS = 5 };
+    unsigned loaded = 0;
+    _Bool first_frame = 1;
 
-    // Cache the losing screen
-    lost_tex = string_cache("You have lost, try again!",(SDL_Color){200, 200, 255, 255});
+    SDL_StopTextInput();
+    enum { STATE_LOADING, STATE_START, STATE_GAME, STATE_LOST, STATE_QUIT } state = STATE_LOADING;
 
-    // Load the background image
-    bg = load_texture("res/bg.bmp");    
+    // The simulation runs in fixed ticks on its own thread, the rendering as fast as the pacing lets it
+    const double freq = (double)SDL_GetPerformanceFrequency();
+
+    // The rounds that were started, the frames of the previous ones are not drawn anymore
+    unsigned round = 0;
+    const struct sim_frame* frame = NULL;
 
-    SDL_StopTextInput();
-    enum { STATE_START, STATE_GAME, STATE_LOST, STATE_QUIT } state = STATE_START;
     while (1) {
 
+        perf_frame_begin();
+
+        Uint64 frame_start = SDL_GetPerformanceCounter();
+
+        // The events go to the simulation right away, they make it into its next tick
         SDL_Event e;
         while (SDL_PollEvent(&e)) {
             switch (e.type) {
                 case SDL_QUIT : 
                     state = STATE_QUIT;
                 break;
+                case SDL_WINDOWEVENT :
+                    if (e.window.event != SDL_WINDOWEVENT_SIZE_CHANGED) break;
+
+                    // The cached text was rasterized for the old size
+                    update_pixel_scale();
+
+                    if (loaded > 1) {
+                        SDL_DestroyTexture(start_tex.tex);
+                        start_tex = screen_text("Press SPACE to play", 1.0);
+                    }
+                    if (loaded > 2) {
+                        SDL_DestroyTexture(lost_tex.tex);
+                        lost_tex = screen_text("You have lost, try again!", 0.8);
+                    }
+                    if (state == STATE_LOST) {
+                        for (size_t i = 0; i < NUM_SCORES; i++) {
+                            SDL_DestroyTexture(lost_info_tex[i]);
+                            lost_info_tex[i] = NULL;
+                        }
+                        game_render_scores(&frame->game, lost_info_tex);
+                        for (size_t i = 0; i < NUM_SCORES; i++)
+                            lost_info[i] = sized(lost_info_tex[i]);
+                    }
+                break;
                 case SDL_KEYDOWN : 
                     switch(e.key.keysym.sym) {
                         case SDLK_SPACE :
                             // START THE GAME !
-                            if (state != STATE_GAME) {
+                            if (state == STATE_START || state == STATE_LOST) {
+
+                                // A recorded round needs to know its seed
+                                unsigned seed = 0;
+                                if (replay_file)
+                                    seed = rep.seed;
+                                else if (record_file)
+                                    seed = SDL_GetTicks() ? SDL_GetTicks() : 1;
+
+                                if (!sim_play(&sim, seed)) break;
+                                round++;
                                 state = STATE_GAME;
 
-                                game_start();
                                 SDL_StartTextInput();
+                                perf_reset();
                             }
     
                         break;
+                        case SDLK_F3 :
+                            perf_overlay_toggle();
+                        break;
                         case SDLK_BACKSPACE : {
-                            game_input_delete(1);
+                            if (replay_file || state != STATE_GAME) break;
+
+                            sim_delete(&sim, 1);
+                            perf_input(e.key.timestamp);
                         } break;
                     }
                 break;
                 case SDL_TEXTINPUT :
-                    game_textinput(e.text.text);
+                    if (replay_file || state != STATE_GAME) break;
+
+                    sim_text(&sim, e.text.text);
+                    perf_input(e.text.timestamp);
                 break;
             }
         }
 
         if (state == STATE_QUIT) break;
 
-        // Clear the background
-        SDL_SetRenderDrawColor(ren, 0, 0, 0, 255);
-        SDL_RenderClear(ren);
+        if (state == STATE_LOADING)
+            switch (loaded) {
+                case 0 :
+                    if (!loader_done(LOAD_WORDS)) break;
+
+                    if (!loader_ok(LOAD_WORDS) || !font_upload() || !game_create(&player)) {
+                        loader_wait();
+                        exit(1);
+                    }
+                    player.visible = 1;
+                    if (!sim_open(&sim, &player, record_file ? &rec : NULL, replay_file ? &rep : NULL)) {
+                        fprintf(stderr, "Failed to start the simulation thread: %s\n", SDL_GetError());
+                        loader_wait();
+                        exit(1);
+                    }
+                    if (replay_file && rep.dict_size != game_dict_size()) {
+                        fprintf(stderr, "The replay was recorded with a different dictionary\n");
+                        loader_wait();
+                        exit(1);
+                    }
+                    loaded++;
+                break;
+                case 1 :
+                    // Cache the starting screen
+                    start_tex = screen_text("Press SPACE to play", 1.0);
+                    loaded++;
+                break;
+                case 2 :
+                    // Cache the losing screen
+                    lost_tex = screen_text("You have lost, try again!", 0.8);
+                    loaded++;
+                break;
+                case 3 :
+                    if (!loader_done(LOAD_BACKGROUND)) break;
+
+                    background_upload(loader_background());
+                    loaded++;
+                break;
+                case 4 :
+                    if (!loader_done(LOAD_SOUNDS)) break;
+
+                    loaded++;
+                    state = STATE_START;
+                    printf("Interactive after %.1f ms\n", (SDL_GetPerformanceCounter() - launch) * 1000.0 / freq);
+                break;
+            }
+
+        // Pick up the newest state of the simulation, the frames of the previous rounds are stale
+        perf_begin(PERF_UPDATE);
+        if (state == STATE_GAME) {
+            frame = sim_frame(&sim);
+            if (frame->round != round) frame = NULL;
+        }
+
+        if (frame && state == STATE_GAME && frame->lost) {
+            state = STATE_LOST;
+
+            // Destroy the textures before rewriting
+            for (size_t i = 0; i < NUM_SCORES; i++)
+                SDL_DestroyTexture(lost_info_tex[i]);
+            // Render the scores to the texture
+            game_render_scores(&frame->game, lost_info_tex);
+            for (size_t i = 0; i < NUM_SCORES; i++)
+                lost_info[i] = sized(lost_info_tex[i]);
+
+            SDL_StopTextInput();
+
+            perf_report(stdout);
+            audio_report(stdout);
+            printf("Simulation ticks late: %u/%u/%u us p50/p99/max\n", histogram_percentile(&frame->late, 0.5),
+                   histogram_percentile(&frame->late, 0.99), frame->late.max);
+
+            // The thread leaves the game and the replays alone until the next round
+            if (record_file && !replay_save(&rec, record_file))
+                fprintf(stderr, "Failed to save the replay %s\n", record_file);
+            if (replay_file)
+                printf(replay_verify(&rep, &player) ? "The replay matches the recorded score\n" :
+                                                      "The replay does not match the recorded score\n");
+        }
+        perf_end(PERF_UPDATE);
+
+        // Clear the background, unless it's all drawn over anyway. A composited frame
+        // covers everything but the letterbox bars
+        perf_begin(PERF_BACKGROUND);
+        _Bool composing = compose_begin(!background_opaque());
+        if (letterboxed || (!composing && !background_opaque())) {
+            SDL_SetRenderDrawColor(ren, 0, 0, 0, 255);
+            SDL_RenderClear(ren);
+            perf.draw_calls++;
+        }
 
         // Render the scrolling background texture
-        SDL_RenderCopy(ren, bg, NULL, &(SDL_Rect){((SDL_GetTicks()/100) % WIDTH), 0, WIDTH, HEIGHT});
-        SDL_RenderCopy(ren, bg, NULL, &(SDL_Rect){((SDL_GetTicks()/100) % WIDTH - WIDTH), 0, WIDTH, HEIGHT});
+        background_draw(SDL_GetTicks());
+        perf_end(PERF_BACKGROUND);
 
         // If we are at the starting or ending screen, draw this dark rectangle
-        if (state != STATE_GAME) {
-            SDL_SetRenderDrawColor(ren, 0,0,0,200);
-            SDL_RenderFillRect(ren, &(SDL_Rect){WIDTH/2-200, 0, 400, HEIGHT});
+        if (state != STATE_GAME)
+            compose_fill((SDL_FRect){WIDTH/2-200, 0, 400, HEIGHT}, (SDL_Color){0, 0, 0, 200});
+
+        if (state == STATE_LOADING) {
+            // A bar, there's no font to write anything with yet
+            compose_fill((SDL_FRect){WIDTH/2-150, HEIGHT/2-5, 300*loaded/LOAD_STEPS, 10}, (SDL_Color){200, 200, 255, 255});
         }
 
+        if (state == STATE_GAME && frame) {
+            // Interpolated from the last tick to the next one
+            double alpha = (SDL_GetPerformanceCounter() - frame->ticked) * 1000.0 / freq / TICK_MS;
+            game_draw(&frame->game, alpha < 1 ? alpha : 1);
+        }
+
+        // The textures of the screens go on top of the composited frame
+        compose_end();
+
         switch (state) {
             case STATE_START :
                 // Just draw "press spacebar to play"
-                render_middle(start_tex, WIDTH/2, HEIGHT/2, 1.0);
-            break;
-            case STATE_GAME : 
-
-                // game_draw returns false if we lost
-                if (!game_draw()) {
-                    state = STATE_LOST; 
-
-                    // Destroy the textures before rewriting
-                    for (size_t i = 0; i < NUM_SCORES; i++)
-                        SDL_DestroyTexture(lost_info_tex[i]);
-                    // Render the scores to the texture
-                    game_render_scores(lost_info_tex);
-
-                    SDL_StopTextInput();
-                }
+                render_middle(start_tex, WIDTH/2, HEIGHT/2);
             break;
             case STATE_LOST :
 
                 // Just draw the "you lost"...
-                render_middle(lost_tex, WIDTH/2, 50, 0.8);
+                render_middle(lost_tex, WIDTH/2, 50);
 
                 // Draw all the scores
                 for (size_t i = 0; i < NUM_SCORES; i++)
-                    if (lost_info_tex[i] != NULL) {
-                        int w, h;
-                        SDL_QueryTexture(lost_info_tex[i], NULL, NULL, &w, &h);    
-                        SDL_RenderCopy(ren, lost_info_tex[i], NULL, &(SDL_Rect){WIDTH/2-180, 20+65+15*i, w/2, h/2});    
+                    if (lost_info[i].tex != NULL) {
+                        SDL_RenderCopyF(ren, lost_info[i].tex, NULL, &(SDL_FRect){WIDTH/2-180, 20+65+15*i, lost_info[i].w, lost_info[i].h});    
+                        perf.draw_calls++;
                     }
 
             break;
@@ -204,28 +472,52 @@ int main(int argc, char *argv[]) {
             break;
         }    
 
+        // The overlay needs the font
+        if (state != STATE_LOADING)
+            perf_overlay_draw(5, 5);
+
+        perf_begin(PERF_PRESENT);
         SDL_RenderPresent(ren);
+        perf_end(PERF_PRESENT);
+        perf_frame_end();
 
-        //TODO: a better loop
-        SDL_Delay(10);
+        if (first_frame) {
+            printf("First frame after %.1f ms\n", (SDL_GetPerformanceCounter() - launch) * 1000.0 / freq);
+            first_frame = 0;
+        }
 
+        // Without vsync, sleep away the rest of the frame
+        if (fps_cap > 0) {
+            double frame_ms = (SDL_GetPerformanceCounter() - frame_start) * 1000.0 / freq;
+            if (frame_ms < 1000.0 / fps_cap)
+                SDL_Delay((Uint32)(1000.0 / fps_cap - frame_ms));
+        }
     }
 
     // The exit takes a while, the window would be lagged and not responding
     SDL_HideWindow(win);
     
-    SDL_DestroyTexture(bg);
-    SDL_DestroyTexture(lost_tex);
-    SDL_DestroyTexture(start_tex);
+    background_dealloc();
+    compose_dealloc();
+    SDL_DestroyTexture(lost_tex.tex);
+    SDL_DestroyTexture(start_tex.tex);
 
     for (size_t i = 0; i < 5; i++)
         if (lost_info_tex[i] != NULL) 
             SDL_DestroyTexture(lost_info_tex[i]);
 
+    loader_wait();
+    sim_close(&sim);
+
+    replay_destroy(&rec);
+    replay_destroy(&rep);
+
+    perf_dealloc();
     font_dealloc();
+    game_destroy(&player);
     game_dealloc();
 
-    Mix_CloseAudio();
+    audio_dealloc();
 
     SDL_DestroyRenderer(ren);
     SDL_DestroyWindow(win);
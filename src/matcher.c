@@ -0,0 +1,226 @@
+#include "matcher.h"
+#include "dict.h"
+#include "utf8.h"
+
+#include <stdint.h>
+#include <stdlib.h> // malloc
+#include <string.h> // memset
+
+#define ROOT 0
+#define NONE UINT32_MAX
+
+_Bool matcher_init(struct matcher* m, size_t count) {
+    m->slot_count = count;
+    m->node_count = count * (WORDLEN-1) + 1; // every word can have its own path
+
+    m->slots = malloc(m->slot_count * sizeof(struct slot));
+    m->nodes = malloc(m->node_count * sizeof(struct node));
+    m->free_nodes = malloc(m->node_count * sizeof(uint32_t));
+
+    // Every node but the root can be an edge
+    size_t edges = 2;
+    while (edges < 2 * m->node_count) edges *= 2;
+    m->edges = malloc(edges * sizeof(struct edge));
+    m->edge_mask = edges - 1;
+
+    if (!m->slots || !m->nodes || !m->free_nodes || !m->edges) {
+        matcher_destroy(m);
+        return 0;
+    }
+
+    matcher_reset(m);
+    return 1;
+}
+
+void matcher_destroy(struct matcher* m) {
+    free(m->slots);
+    free(m->nodes);
+    free(m->free_nodes);
+    free(m->edges);
+    m->slots = NULL;
+    m->nodes = NULL;
+    m->free_nodes = NULL;
+    m->edges = NULL;
+    m->slot_count = m->node_count = 0;
+}
+
+void matcher_reset(struct matcher* m) {
+    memset(m->slots, 0, m->slot_count * sizeof(struct slot));
+
+    memset(m->edges, 0, (m->edge_mask + 1) * sizeof(struct edge));
+
+    memset(&m->nodes[ROOT], 0, sizeof(struct node));
+    m->nodes[ROOT].refs = 1;
+    m->nodes[ROOT].ends = NONE;
+
+    // The lowest nodes get reused first
+    m->free_count = 0;
+    for (size_t i = m->node_count; i-- > 1; )
+        m->free_nodes[m->free_count++] = i;
+
+    m->input_len = m->matched_len = 0;
+    m->input_path[0] = ROOT;
+}
+
+static size_t edge_hash(const struct matcher* m, uint32_t parent, uint32_t letter) {
+    return ((parent * 0x9E3779B1u) ^ (letter * 0x85EBCA77u)) & m->edge_mask;
+}
+
+// The entry of the edge, or the free one where it would go
+static size_t edge_find(const struct matcher* m, uint32_t parent, uint32_t letter) {
+    size_t i = edge_hash(m, parent, letter);
+    while (m->edges[i].child != ROOT && (m->edges[i].parent != parent || m->edges[i].letter != letter))
+        i = (i + 1) & m->edge_mask;
+    return i;
+}
+
+static uint32_t child_get(const struct matcher* m, uint32_t node, uint32_t letter) {
+    if (letter - 'a' < 26)
+        return m->nodes[node].child[letter-'a'];
+
+    return m->edges[edge_find(m, node, letter)].child;
+}
+
+static void child_set(struct matcher* m, uint32_t node, uint32_t letter, uint32_t child) {
+    if (letter - 'a' < 26) {
+        m->nodes[node].child[letter-'a'] = child;
+        return;
+    }
+
+    m->edges[edge_find(m, node, letter)] = (struct edge){node, letter, child};
+}
+
+static void child_unset(struct matcher* m, uint32_t node, uint32_t letter) {
+    if (letter - 'a' < 26) {
+        m->nodes[node].child[letter-'a'] = ROOT;
+        return;
+    }
+
+    // Backward shift: the entries after the hole that would probe through it move into it
+    size_t hole = edge_find(m, node, letter);
+    for (size_t i = (hole + 1) & m->edge_mask; m->edges[i].child != ROOT; i = (i + 1) & m->edge_mask) {
+        size_t home = edge_hash(m, m->edges[i].parent, m->edges[i].letter);
+        if (((i - home) & m->edge_mask) >= ((i - hole) & m->edge_mask)) {
+            m->edges[hole] = m->edges[i];
+            hole = i;
+        }
+    }
+    m->edges[hole].child = ROOT;
+}
+
+// Follow the input further down the trie, as far as it goes
+static void input_descend(struct matcher* m) {
+    while (m->matched_len < m->input_len) {
+        uint32_t child = child_get(m, m->input_path[m->matched_len], m->input[m->matched_len]);
+        if (child == ROOT) return;
+
+        m->input_path[++m->matched_len] = child;
+    }
+}
+
+void matcher_insert(struct matcher* m, size_t slot, const char* word) {
+    struct slot* s = &m->slots[slot];
+    if (s->used) matcher_remove(m, slot);
+
+    uint32_t node = ROOT;
+    s->path[0] = ROOT;
+    s->len = 0;
+
+    while (*word && s->len < WORDLEN-1) {
+        uint32_t letter = utf8_next(&word);
+        uint32_t child = child_get(m, node, letter);
+
+        if (child == ROOT) {
+            child = m->free_nodes[--m->free_count];
+            memset(&m->nodes[child], 0, sizeof(struct node));
+            m->nodes[child].parent = node;
+            m->nodes[child].ends = NONE;
+            m->nodes[child].letter = letter;
+            child_set(m, node, letter, child);
+        }
+
+        node = child;
+        m->nodes[node].refs++;
+        s->path[++s->len] = node;
+    }
+
+    // Put it at the front of the node's list of words
+    s->prev_end = NONE;
+    s->next_end = m->nodes[node].ends;
+    if (s->next_end != NONE) m->slots[s->next_end].prev_end = slot;
+    m->nodes[node].ends = slot;
+
+    s->used = 1;
+
+    // The input might go further now
+    input_descend(m);
+}
+
+void matcher_remove(struct matcher* m, size_t slot) {
+    struct slot* s = &m->slots[slot];
+    if (!s->used) return;
+
+    // Unlink it from the node's list of words
+    uint32_t end = s->path[s->len];
+    if (s->prev_end != NONE) m->slots[s->prev_end].next_end = s->next_end;
+    else m->nodes[end].ends = s->next_end;
+    if (s->next_end != NONE) m->slots[s->next_end].prev_end = s->prev_end;
+
+    // Release the path bottom up, the nodes that nobody uses anymore are freed
+    for (size_t d = s->len; d > 0; d--) {
+        uint32_t n = s->path[d];
+        if (--m->nodes[n].refs == 0) {
+            child_unset(m, m->nodes[n].parent, m->nodes[n].letter);
+            m->free_nodes[m->free_count++] = n;
+        }
+    }
+
+    // If the input went through the freed nodes, it only matches as far as what is left
+    while (m->matched_len > 0 && m->nodes[m->input_path[m->matched_len]].refs == 0)
+        m->matched_len--;
+
+    s->used = 0;
+}
+
+void matcher_push(struct matcher* m, uint32_t cp) {
+    if (m->input_len >= WORDLEN-1) return;
+
+    m->input[m->input_len++] = cp;
+    input_descend(m);
+}
+
+void matcher_clear_input(struct matcher* m) {
+    m->input_len = m->matched_len = 0;
+}
+
+void matcher_pop(struct matcher* m) {
+    if (m->input_len == 0) return;
+
+    if (m->matched_len == m->input_len) m->matched_len--;
+    m->input_len--;
+}
+
+size_t matcher_highlight(const struct matcher* m, size_t slot) {
+    const struct slot* s = &m->slots[slot];
+
+    // It is enough to compare the nodes where the shorter one of them ends
+    size_t k = s->len < m->input_len ? s->len : m->input_len;
+
+    if (k > m->matched_len || s->path[k] != m->input_path[k])
+        return 0;
+
+    return k;
+}
+
+size_t matcher_first_match(const struct matcher* m) {
+    if (m->matched_len != m->input_len || m->input_len == 0)
+        return MATCHER_NONE;
+
+    uint32_t first = m->nodes[m->input_path[m->matched_len]].ends;
+    return first == NONE ? MATCHER_NONE : first;
+}
+
+size_t matcher_next_match(const struct matcher* m, size_t slot) {
+    uint32_t next = m->slots[slot].next_end;
+    return next == NONE ? MATCHER_NONE : next;
+}
@@ -1,58 +1,245 @@
 #include "particles.h"
+#include "compose.h"
+#include "perf.h"
+#include "rng.h"
 
 #include <SDL.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h> // memcpy
 #include <math.h>
 
-#define RANDOM() ((double)rand()/RAND_MAX)
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-#define POOLSIZE 256
-#define BURSTSIZE 32
-
-struct particle {
-    double x, y;
-    double vx, vy;
-};
+// Their own generator, so that only the inputs decide where a round goes,
+// whether its particles are shown or not
+static struct rng particles_rng;
+#define RANDOM() rng_double(&particles_rng)
 
-static struct particle ppool[POOLSIZE];
-static size_t ppool_oldest = 0;
+#define BURSTSIZE 32
+#define MAXPARTICLES 65536
+
+// The velocity is multiplied by this every tick
+#define DAMPING 0.995f
+// The alpha of a particle is its horizontal speed times 255, slower particles are invisible
+#define MIN_SPEED (1.0f/255.0f)
+
+// The particles as a structure of arrays, the live ones are always [0, live)
+static struct {
+    float* x, *y;
+    float* vx, *vy;
+    int32_t* life; // the ticks until the particle fades out
+    size_t live, cap;
+    size_t overwrite; // where new particles go when the pool can't grow anymore
+} pp;
+
+// The quads of all the particles, drawn in one call
+static SDL_Vertex* verts;
+static int* indices;
+static size_t verts_cap = 0; // in particles
+
+static _Bool pool_grow() {
+    if (pp.cap >= MAXPARTICLES)
+        return 0;
+
+    size_t cap = pp.cap ? pp.cap * 2 : 256;
+
+    float* x = realloc(pp.x, cap * sizeof(float));
+    if (x) pp.x = x;
+    float* y = realloc(pp.y, cap * sizeof(float));
+    if (y) pp.y = y;
+    float* vx = realloc(pp.vx, cap * sizeof(float));
+    if (vx) pp.vx = vx;
+    float* vy = realloc(pp.vy, cap * sizeof(float));
+    if (vy) pp.vy = vy;
+    int32_t* life = realloc(pp.life, cap * sizeof(int32_t));
+    if (life) pp.life = life;
+
+    if (!x || !y || !vx || !vy || !life)
+        return 0;
+
+    pp.cap = cap;
+    return 1;
+}
 
 void particles_reset() {
-    // There isn't really a way to remove the particles becuse *THEY'RE THERE* at all times
-    // All I can do is set the velocity to 0, which makes the particle invisible
-    memset(ppool, 0, sizeof(ppool));
-    ppool_oldest = 0;
+    rng_seed(&particles_rng, 1);
+
+    // The pool is kept for the next round
+    pp.live = 0;
+    pp.overwrite = 0;
 }
 
 void particles_start(int x, int y) {
 
-    for (size_t i = 0; i < BURSTSIZE; i++, ppool_oldest = (ppool_oldest+1) % POOLSIZE) {
-
-        ppool[ppool_oldest].x = (double)(x);
-        ppool[ppool_oldest].y = (double)(y);
+    for (size_t b = 0; b < BURSTSIZE; b++) {
 
         double angle = RANDOM() * M_PI * 2;
+        float vx = cos(angle)*RANDOM()*2;
+        float vy = sin(angle)*RANDOM()*2;
+
+        // It would never be seen
+        if (fabsf(vx) < MIN_SPEED)
+            continue;
+
+        size_t i;
+        if (pp.live < pp.cap || pool_grow())
+            i = pp.live++;
+        else {
+            // The pool is at its limit, replace some of the live ones
+            i = pp.overwrite;
+            pp.overwrite = (pp.overwrite + 1) % pp.live;
+        }
+
+        pp.x[i] = x;
+        pp.y[i] = y;
+        pp.vx[i] = vx;
+        pp.vy[i] = vy;
+
+        // The number of ticks until |vx| * DAMPING^n drops below MIN_SPEED
+        pp.life[i] = (int32_t)ceilf(logf(MIN_SPEED / fabsf(vx)) / logf(DAMPING));
+    }
+}
+
+void particles_update() {
 
-        ppool[ppool_oldest].vx = cos(angle)*RANDOM()*2;
-        ppool[ppool_oldest].vy = sin(angle)*RANDOM()*2;
+    float* x = pp.x, *y = pp.y, *vx = pp.vx, *vy = pp.vy;
+    int32_t* life = pp.life;
+    size_t n = pp.live, i = 0;
+
+    // Decrease their velocity a bit and move them
+#if defined(__AVX__)
+    const __m256 damping = _mm256_set1_ps(DAMPING);
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_mul_ps(_mm256_loadu_ps(vx+i), damping);
+        _mm256_storeu_ps(vx+i, v);
+        _mm256_storeu_ps(x+i, _mm256_add_ps(_mm256_loadu_ps(x+i), v));
+
+        v = _mm256_mul_ps(_mm256_loadu_ps(vy+i), damping);
+        _mm256_storeu_ps(vy+i, v);
+        _mm256_storeu_ps(y+i, _mm256_add_ps(_mm256_loadu_ps(y+i), v));
+    }
+#elif defined(__SSE2__)
+    const __m128 damping = _mm_set1_ps(DAMPING);
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(vx+i), damping);
+        _mm_storeu_ps(vx+i, v);
+        _mm_storeu_ps(x+i, _mm_add_ps(_mm_loadu_ps(x+i), v));
+
+        v = _mm_mul_ps(_mm_loadu_ps(vy+i), damping);
+        _mm_storeu_ps(vy+i, v);
+        _mm_storeu_ps(y+i, _mm_add_ps(_mm_loadu_ps(y+i), v));
+    }
+#endif
+    for (; i < n; i++) {
+        x[i] += vx[i] *= DAMPING;
+        y[i] += vy[i] *= DAMPING;
     }
+
+    // Age them and swap the dead ones out of the live range
+    for (i = 0; i < n; ) {
+        if (--life[i] > 0) {
+            i++;
+            continue;
+        }
+
+        n--;
+        x[i] = x[n]; y[i] = y[n];
+        vx[i] = vx[n]; vy[i] = vy[n];
+        life[i] = life[n];
+    }
+
+    pp.live = n;
+    if (pp.overwrite >= n) pp.overwrite = 0;
 }
 
-void particles_draw() {
+size_t particles_count() {
+    return pp.live;
+}
+
+void particles_copy(float* x, float* y, float* vx) {
+    memcpy(x, pp.x, pp.live * sizeof(float));
+    memcpy(y, pp.y, pp.live * sizeof(float));
+    memcpy(vx, pp.vx, pp.live * sizeof(float));
+}
+
+// Make slower particles darker
+static SDL_Color particle_color(float vx) {
+    float alpha = fabsf(vx)*255.0f;
+    if (alpha > 255.0f) alpha = 255.0f;
+    return (SDL_Color){100+alpha/2, 200+alpha/5, 255, (Uint8)alpha};
+}
+
+void particles_draw(const float* px, const float* py, const float* pvx, size_t n) {
 
     extern SDL_Renderer* ren;
 
-    for (size_t i = 0; i < POOLSIZE; i++) {
+    if (n == 0)
+        return;
+
+    // A composited frame fills the squares right away
+    if (compose_active()) {
+        for (size_t i = 0; i < n; i++)
+            compose_fill((SDL_FRect){(int)px[i], (int)py[i], 3, 3}, particle_color(pvx[i]));
+        return;
+    }
+
+    if (n > verts_cap) {
+        size_t cap = verts_cap ? verts_cap : 256;
+        while (cap < n) cap *= 2;
 
-        // Make slower particles darker
-        double alpha = fabs(ppool[i].vx)*255.0;
-        SDL_SetRenderDrawColor(ren, 100+alpha/2, 200+alpha/5, 255, (int)alpha);
+        SDL_Vertex* v = realloc(verts, cap * 4 * sizeof(SDL_Vertex));
+        if (!v) return;
+        verts = v;
 
-        // Draw the particle
-        SDL_RenderFillRect(ren, &(SDL_Rect){(int)ppool[i].x, (int)ppool[i].y, 3, 3});
+        int* in = realloc(indices, cap * 6 * sizeof(int));
+        if (!in) return;
+        indices = in;
 
-        // Decrease their velocity a bit
-        ppool[i].x += ppool[i].vx*=0.995;
-        ppool[i].y += ppool[i].vy*=0.995;
+        // The indices never change, so they're only written when growing
+        for (size_t i = verts_cap; i < cap; i++) {
+            int base = i*4;
+            int* q = &indices[i*6];
+            q[0] = base; q[1] = base+1; q[2] = base+2;
+            q[3] = base; q[4] = base+2; q[5] = base+3;
+        }
+
+        verts_cap = cap;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+
+        SDL_Color col = particle_color(pvx[i]);
+        float x = (int)px[i], y = (int)py[i];
+
+        SDL_Vertex* v = &verts[i*4];
+        v[0] = (SDL_Vertex){{x,   y  }, col, {0, 0}};
+        v[1] = (SDL_Vertex){{x+3, y  }, col, {0, 0}};
+        v[2] = (SDL_Vertex){{x+3, y+3}, col, {0, 0}};
+        v[3] = (SDL_Vertex){{x,   y+3}, col, {0, 0}};
     }
+
+    SDL_RenderGeometry(ren, NULL, verts, n*4, indices, n*6);
+    perf.draw_calls++;
+}
+
+void particles_dealloc() {
+    free(pp.x);
+    free(pp.y);
+    free(pp.vx);
+    free(pp.vy);
+    free(pp.life);
+    free(verts);
+    free(indices);
+
+    pp.x = pp.y = pp.vx = pp.vy = NULL;
+    pp.life = NULL;
+    pp.live = pp.cap = 0;
+    verts = NULL;
+    indices = NULL;
+    verts_cap = 0;
 }
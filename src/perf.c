@@ -0,0 +1,273 @@
+#include "perf.h"
+#include "text.h"
+#include "stats.h"
+
+#include <stdlib.h> // qsort
+#include <string.h> // memset, strlen
+
+// The number of frames kept for the overlay and between trace writes
+#define PERF_FRAMES 1024
+
+// How often the overlay text is refreshed, in ms
+#define OVERLAY_REFRESH 500
+
+struct perf_counters perf;
+
+static const char* phase_names[PERF_PHASES] = {
+    "update", "background", "words", "particles", "hud", "present"
+};
+
+struct perf_frame {
+    double start, time; // in us, since the first frame
+    double phase_start[PERF_PHASES], phase_time[PERF_PHASES]; // phase_start is negative if not entered
+    unsigned draw_calls, texture_uploads;
+};
+
+// The last PERF_FRAMES frames
+static struct perf_frame frames[PERF_FRAMES];
+static unsigned long long frame_count = 0;
+
+// The frame being measured
+static struct perf_frame cur;
+static double phase_entered[PERF_PHASES];
+static Uint64 epoch = 0;
+
+static FILE* trace = NULL;
+static _Bool trace_json;
+static unsigned long long trace_written = 0; // frames written to the trace
+
+static _Bool overlay_visible = 0;
+static Uint32 overlay_updated = 0;
+static char overlay_str[3][64];
+static struct text_label overlay_labels[3];
+
+// Totals accumulated since the last report
+static unsigned long long total_draw_calls = 0;
+static unsigned long long total_texture_uploads = 0, total_texture_queries = 0;
+static unsigned long long total_label_hits = 0, total_label_misses = 0;
+static unsigned long long total_glyph_misses = 0, total_glyph_evictions = 0;
+static unsigned long long total_composed = 0;
+static unsigned long long total_frames = 0;
+
+// Keystroke to present latency, of every key that is not on the screen yet
+#define PERF_PENDING 64
+static Uint32 pending_input[PERF_PENDING];
+static size_t inputs_pending = 0;
+static struct histogram latency;
+
+// The time between two keystrokes, longer pauses than this aren't typing
+#define KEY_PAUSE 5000
+static struct histogram key_interval;
+static Uint32 last_key;
+static _Bool key_seen = 0;
+
+static double now_us() {
+    return (SDL_GetPerformanceCounter() - epoch) * 1e6 / SDL_GetPerformanceFrequency();
+}
+
+void perf_begin(enum perf_phase phase) {
+    phase_entered[phase] = now_us();
+    if (cur.phase_start[phase] < 0)
+        cur.phase_start[phase] = phase_entered[phase];
+}
+
+void perf_end(enum perf_phase phase) {
+    cur.phase_time[phase] += now_us() - phase_entered[phase];
+}
+
+void perf_input(Uint32 timestamp) {
+    if (key_seen && timestamp - last_key < KEY_PAUSE)
+        histogram_add(&key_interval, timestamp - last_key);
+    last_key = timestamp;
+    key_seen = 1;
+
+    // More keys than this in one frame would only be a flood, they all have the same latency anyway
+    if (inputs_pending < PERF_PENDING)
+        pending_input[inputs_pending++] = timestamp;
+}
+
+// Write all the frames that haven't been written yet, they are all still in the ring
+static void trace_flush() {
+    for (; trace_written < frame_count; trace_written++) {
+        const struct perf_frame* f = &frames[trace_written % PERF_FRAMES];
+
+        if (trace_json) {
+            fprintf(trace, "%s{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.1f,\"dur\":%.1f,"
+                           "\"args\":{\"draw_calls\":%u,\"texture_uploads\":%u}}",
+                    trace_written ? ",\n" : "", f->start, f->time, f->draw_calls, f->texture_uploads);
+
+            for (size_t p = 0; p < PERF_PHASES; p++)
+                if (f->phase_start[p] >= 0)
+                    fprintf(trace, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.1f,\"dur\":%.1f}",
+                            phase_names[p], f->phase_start[p], f->phase_time[p]);
+        } else {
+            fprintf(trace, "%llu,%.1f,%.1f", trace_written, f->start, f->time);
+            for (size_t p = 0; p < PERF_PHASES; p++)
+                fprintf(trace, ",%.1f", f->phase_time[p]);
+            fprintf(trace, ",%u,%u\n", f->draw_calls, f->texture_uploads);
+        }
+    }
+}
+
+_Bool perf_trace_open(const char* filename) {
+    trace = fopen(filename, "w");
+    if (!trace) return 0;
+
+    size_t len = strlen(filename);
+    trace_json = len >= 5 && !strcmp(filename + len - 5, ".json");
+
+    if (trace_json)
+        fprintf(trace, "{\"traceEvents\":[\n");
+    else {
+        fprintf(trace, "frame,start_us,frame_us");
+        for (size_t p = 0; p < PERF_PHASES; p++)
+            fprintf(trace, ",%s_us", phase_names[p]);
+        fprintf(trace, ",draw_calls,texture_uploads\n");
+    }
+
+    trace_written = frame_count;
+    return 1;
+}
+
+void perf_dealloc() {
+    if (trace) {
+        trace_flush();
+        if (trace_json)
+            fprintf(trace, "\n]}\n");
+        fclose(trace);
+        trace = NULL;
+    }
+
+    for (size_t i = 0; i < sizeof(overlay_labels)/sizeof(overlay_labels[0]); i++)
+        label_destroy(&overlay_labels[i]);
+}
+
+void perf_frame_begin() {
+    if (epoch == 0)
+        epoch = SDL_GetPerformanceCounter();
+
+    memset(&cur, 0, sizeof(cur));
+    for (size_t p = 0; p < PERF_PHASES; p++)
+        cur.phase_start[p] = -1;
+
+    cur.start = now_us();
+}
+
+void perf_frame_end() {
+    cur.time = now_us() - cur.start;
+    cur.draw_calls = perf.draw_calls;
+    cur.texture_uploads = perf.texture_uploads;
+
+    frames[frame_count % PERF_FRAMES] = cur;
+    frame_count++;
+
+    // Write the trace before the ring wraps around
+    if (trace && frame_count - trace_written >= PERF_FRAMES)
+        trace_flush();
+
+    total_draw_calls += perf.draw_calls;
+    total_texture_uploads += perf.texture_uploads;
+    total_texture_queries += perf.texture_queries;
+    total_label_hits += perf.label_hits;
+    total_label_misses += perf.label_misses;
+    total_glyph_misses += perf.glyph_misses;
+    total_glyph_evictions += perf.glyph_evictions;
+    total_composed += perf.composed;
+    total_frames++;
+
+    if (inputs_pending) {
+        Uint32 now = SDL_GetTicks();
+        for (size_t i = 0; i < inputs_pending; i++)
+            histogram_add(&latency, now - pending_input[i]);
+
+        inputs_pending = 0;
+    }
+
+    memset(&perf, 0, sizeof(perf));
+}
+
+void perf_reset() {
+    total_draw_calls = total_frames = 0;
+    total_texture_uploads = total_texture_queries = 0;
+    total_label_hits = total_label_misses = 0;
+    total_glyph_misses = total_glyph_evictions = 0;
+    total_composed = 0;
+    histogram_reset(&latency);
+    histogram_reset(&key_interval);
+    key_seen = 0;
+}
+
+void perf_report(FILE* f) {
+    if (total_frames == 0)
+        return;
+
+    fprintf(f, "Draw calls per frame: %.1f (%llu frames)\n",
+            (double)total_draw_calls / total_frames, total_frames);
+    fprintf(f, "Texture uploads per frame: %.2f\n", (double)total_texture_uploads / total_frames);
+    fprintf(f, "Texture queries per frame: %.2f\n", (double)total_texture_queries / total_frames);
+    fprintf(f, "Label cache: %llu hits, %llu misses\n", total_label_hits, total_label_misses);
+    fprintf(f, "Glyph cache: %llu misses, %llu shelves evicted\n", total_glyph_misses, total_glyph_evictions);
+    if (total_composed)
+        fprintf(f, "Composited on the CPU per frame: %.1f fills and blits\n", (double)total_composed / total_frames);
+    if (latency.count)
+        fprintf(f, "Input to present latency: %.1f ms average, %u/%u/%u ms p50/p95/p99, %u ms max\n",
+                (double)latency.sum / latency.count, histogram_percentile(&latency, 0.5),
+                histogram_percentile(&latency, 0.95), histogram_percentile(&latency, 0.99), latency.max);
+    if (key_interval.count)
+        fprintf(f, "Time between keys: %u/%u/%u ms p10/p50/p90 over %llu keys\n",
+                histogram_percentile(&key_interval, 0.1), histogram_percentile(&key_interval, 0.5),
+                histogram_percentile(&key_interval, 0.9), (unsigned long long)key_interval.count);
+
+    perf_reset();
+}
+
+void perf_overlay_toggle() {
+    overlay_visible = !overlay_visible;
+    overlay_updated = 0;
+}
+
+static int cmp_double(const void* a, const void* b) {
+    double da = *(const double*)a, db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+void perf_overlay_draw(int x, int y) {
+    extern SDL_Renderer* ren;
+
+    if (!overlay_visible || frame_count == 0)
+        return;
+
+    // The numbers change every frame, so the texts are only refreshed now and then,
+    // in between the labels don't have to be rendered again
+    if (overlay_updated == 0 || SDL_GetTicks() - overlay_updated >= OVERLAY_REFRESH) {
+        overlay_updated = SDL_GetTicks();
+
+        size_t n = frame_count < PERF_FRAMES ? frame_count : PERF_FRAMES;
+        static double times[PERF_FRAMES];
+        double phases[PERF_PHASES] = {0};
+        double draw_calls = 0, uploads = 0;
+
+        for (size_t i = 0; i < n; i++) {
+            times[i] = frames[i].time / 1000.0;
+            for (size_t p = 0; p < PERF_PHASES; p++)
+                phases[p] += frames[i].phase_time[p] / 1000.0 / n;
+            draw_calls += (double)frames[i].draw_calls / n;
+            uploads += (double)frames[i].texture_uploads / n;
+        }
+
+        qsort(times, n, sizeof(double), cmp_double);
+
+        snprintf(overlay_str[0], sizeof(overlay_str[0]), "Frame ms p50 %.2f p95 %.2f p99 %.2f", times[n/2], times[n*95/100], times[n*99/100]);
+        snprintf(overlay_str[1], sizeof(overlay_str[1]), "Upd %.2f Bg %.2f Wrd %.2f Ptc %.2f Hud %.2f Pre %.2f",
+                phases[PERF_UPDATE], phases[PERF_BACKGROUND], phases[PERF_WORDS],
+                phases[PERF_PARTICLES], phases[PERF_HUD], phases[PERF_PRESENT]);
+        snprintf(overlay_str[2], sizeof(overlay_str[2]), "Draw calls %.1f Uploads %.2f", draw_calls, uploads);
+    }
+
+    SDL_SetRenderDrawColor(ren, 0, 0, 0, 180);
+    SDL_RenderFillRect(ren, &(SDL_Rect){x, y, 330, 50});
+    perf.draw_calls++;
+
+    for (size_t i = 0; i < 3; i++)
+        render_label(&overlay_labels[i], overlay_str[i], x+5, y+3+15*i, 0.4);
+}
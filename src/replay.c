@@ -0,0 +1,216 @@
+#include "replay.h"
+#include "game.h"
+
+#include <stdio.h> // FILE
+#include <stdlib.h> // realloc
+#include <string.h> // memset, strlen
+
+enum {
+    EVENT_TEXT = 1, // followed by the length and the text
+    EVENT_DELETE = 2 // followed by a varint count
+};
+
+// The file starts with this, every field is little endian so the replays can be shared
+static const char replay_magic[4] = {'W', 'S', 'R', 'P'};
+#define    HEADER_FIELDS 9
+
+void replay_begin(struct replay* r, uint32_t seed, uint32_t stream_size, uint32_t dict_size) {
+    free(r->data);
+    memset(r, 0, sizeof(*r));
+
+    r->seed = seed;
+    r->stream_size = stream_size;
+    r->dict_size = dict_size;
+    r->adaptive = game_adaptive();
+}
+
+void replay_destroy(struct replay* r) {
+    free(r->data);
+    memset(r, 0, sizeof(*r));
+}
+
+static _Bool reserve(struct replay* r, size_t n) {
+    if (r->size + n <= r->cap) return 1;
+
+    size_t cap = r->cap ? r->cap * 2 : 1024;
+    while (cap < r->size + n) cap *= 2;
+
+    uint8_t* data = realloc(r->data, cap);
+    if (!data) return 0;
+
+    r->data = data;
+    r->cap = cap;
+    return 1;
+}
+
+static void put_varint(struct replay* r, uint32_t v) {
+    for (; v >= 0x80; v >>= 7)
+        r->data[r->size++] = (v & 0x7f) | 0x80;
+    r->data[r->size++] = v;
+}
+
+static _Bool get_varint(struct replay* r, uint32_t* v) {
+    *v = 0;
+    for (unsigned shift = 0; shift < 35; shift += 7) {
+        if (r->pos >= r->size) return 0;
+
+        uint8_t b = r->data[r->pos++];
+        *v |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return 1;
+    }
+    return 0;
+}
+
+// The tick delta and the event type, 5 bytes at most for the varint
+static _Bool put_event(struct replay* r, uint32_t tick, uint8_t type, size_t extra) {
+    if (tick < r->last_tick || !reserve(r, 6 + extra)) return 0;
+
+    put_varint(r, tick - r->last_tick);
+    r->data[r->size++] = type;
+    r->last_tick = tick;
+    return 1;
+}
+
+_Bool replay_text(struct replay* r, uint32_t tick, const char* str) {
+    size_t len = strlen(str);
+    if (len == 0 || len > 255 || !put_event(r, tick, EVENT_TEXT, 1 + len)) return 0;
+
+    r->data[r->size++] = len;
+    memcpy(r->data + r->size, str, len);
+    r->size += len;
+    return 1;
+}
+
+_Bool replay_delete(struct replay* r, uint32_t tick, size_t num) {
+    if (num == 0 || num > UINT32_MAX || !put_event(r, tick, EVENT_DELETE, 5)) return 0;
+
+    put_varint(r, num);
+    return 1;
+}
+
+void replay_end(struct replay* r, const struct game* g) {
+    r->ticks = game_tick(g);
+    game_score(g, &r->words, &r->chars, &r->cpm_best);
+}
+
+static void put_u32(uint8_t* p, uint32_t v) {
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+_Bool replay_save(const struct replay* r, const char* filename) {
+    // The magic, the header fields and the size of the events
+    uint8_t header[4 + 4*HEADER_FIELDS + 4];
+    memcpy(header, replay_magic, 4);
+
+    const uint32_t fields[HEADER_FIELDS] = {
+        REPLAY_VERSION, r->seed, r->stream_size, r->dict_size, r->ticks, r->words, r->chars, r->cpm_best, r->adaptive
+    };
+    for (size_t i = 0; i < HEADER_FIELDS; i++)
+        put_u32(header + 4 + 4*i, fields[i]);
+    put_u32(header + 4 + 4*HEADER_FIELDS, r->size);
+
+    FILE* f = fopen(filename, "wb");
+    if (!f) return 0;
+
+    _Bool ok = fwrite(header, sizeof(header), 1, f) == 1 &&
+               (r->size == 0 || fwrite(r->data, r->size, 1, f) == 1);
+
+    return fclose(f) == 0 && ok;
+}
+
+_Bool replay_load(struct replay* r, const char* filename) {
+    memset(r, 0, sizeof(*r));
+
+    FILE* f = fopen(filename, "rb");
+    if (!f) return 0;
+
+    uint8_t header[4 + 4*HEADER_FIELDS + 4];
+    if (fread(header, sizeof(header), 1, f) != 1 || memcmp(header, replay_magic, 4) ||
+        get_u32(header + 4) != REPLAY_VERSION) {
+        fclose(f);
+        return 0;
+    }
+
+    r->seed = get_u32(header + 8);
+    r->stream_size = get_u32(header + 12);
+    r->dict_size = get_u32(header + 16);
+    r->ticks = get_u32(header + 20);
+    r->words = get_u32(header + 24);
+    r->chars = get_u32(header + 28);
+    r->cpm_best = get_u32(header + 32);
+    r->adaptive = get_u32(header + 36);
+    size_t size = get_u32(header + 40);
+
+    if (size && (!reserve(r, size) || fread(r->data, size, 1, f) != 1)) {
+        fclose(f);
+        replay_destroy(r);
+        return 0;
+    }
+    r->size = size;
+
+    fclose(f);
+    return 1;
+}
+
+_Bool replay_append(struct replay* r, const uint8_t* data, size_t size) {
+    if (size == 0) return 1;
+    if (!reserve(r, size)) return 0;
+
+    memcpy(r->data + r->size, data, size);
+    r->size += size;
+    return 1;
+}
+
+void replay_rewind(struct replay* r) {
+    r->pos = 0;
+    r->last_tick = 0;
+}
+
+void replay_apply(struct replay* r, struct game* g) {
+    const uint32_t tick = game_tick(g);
+
+    while (r->pos < r->size) {
+        // Peek at the tick of the next event
+        size_t start = r->pos;
+        uint32_t delta;
+        if (!get_varint(r, &delta) || r->pos >= r->size) break;
+
+        if (r->last_tick + delta > tick) {
+            r->pos = start;
+            return;
+        }
+        r->last_tick += delta;
+
+        uint8_t type = r->data[r->pos++];
+        if (type == EVENT_TEXT) {
+            if (r->pos >= r->size || r->pos + 1 + r->data[r->pos] > r->size) break;
+
+            char str[256];
+            size_t len = r->data[r->pos++];
+            memcpy(str, r->data + r->pos, len);
+            str[len] = '\0';
+            r->pos += len;
+
+            game_textinput(g, str);
+        } else if (type == EVENT_DELETE) {
+            uint32_t num;
+            if (!get_varint(r, &num)) break;
+
+            game_input_delete(g, num);
+        } else break;
+    }
+
+    // A broken replay is played up to the broken event
+    r->pos = r->size;
+}
+
+_Bool replay_verify(const struct replay* r, const struct game* g) {
+    unsigned words, chars, cpm_best;
+    game_score(g, &words, &chars, &cpm_best);
+
+    return game_tick(g) == r->ticks && words == r->words && chars == r->chars && cpm_best == r->cpm_best;
+}
@@ -0,0 +1,45 @@
+#include "rng.h"
+
+static uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+void rng_seed(struct rng* r, uint64_t seed) {
+    // splitmix64 spreads the seed over the whole state, so that it's never all zeroes
+    for (int i = 0; i < 4; i++) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        r->s[i] = z ^ (z >> 31);
+    }
+}
+
+uint64_t rng_next(struct rng* r) {
+    uint64_t* s = r->s;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+
+    return result;
+}
+
+uint64_t rng_range(struct rng* r, uint64_t n) {
+    // Reject the top values that would make the modulo biased, this almost never loops
+    uint64_t threshold = -n % n;
+    for (;;) {
+        uint64_t x = rng_next(r);
+        if (x >= threshold)
+            return x % n;
+    }
+}
+
+double rng_double(struct rng* r) {
+    return (rng_next(r) >> 11) * (1.0 / 9007199254740992.0);
+}
@@ -0,0 +1,211 @@
+#include "sim.h"
+
+#include <string.h> // memset, strncpy
+
+// Marks the latest frame as not taken by the renderer yet
+#define    SIM_FRESH 4
+
+// Don't try to catch up after long stalls, skip the time instead
+#define    SIM_MAX_CATCHUP 25
+
+static _Bool sim_push(struct sim* s, const struct sim_input* in) {
+    int head = SDL_AtomicGet(&s->head);
+    if (head - SDL_AtomicGet(&s->tail) >= SIM_QUEUE) {
+        s->dropped++;
+        return 0;
+    }
+
+    s->queue[head % SIM_QUEUE] = *in;
+
+    // The input has to be complete before the thread can see it
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&s->head, head + 1);
+
+    SDL_SemPost(s->wake);
+    return 1;
+}
+
+_Bool sim_play(struct sim* s, unsigned seed) {
+    return sim_push(s, &(struct sim_input){SIM_PLAY, seed, ""});
+}
+
+_Bool sim_text(struct sim* s, const char* text) {
+    struct sim_input in = {SIM_TEXT, 0, ""};
+    strncpy(in.text, text, sizeof(in.text)-1);
+    return sim_push(s, &in);
+}
+
+_Bool sim_delete(struct sim* s, unsigned num) {
+    return sim_push(s, &(struct sim_input){SIM_DELETE, num, ""});
+}
+
+// Plays the queued inputs into the game, returns true if there were any
+static _Bool sim_drain(struct sim* s, unsigned* round, _Bool* playing) {
+    struct game* g = s->game;
+
+    int head = SDL_AtomicGet(&s->head), tail = SDL_AtomicGet(&s->tail);
+    SDL_MemoryBarrierAcquire();
+    if (head == tail) return 0;
+
+    for (; tail != head; tail++) {
+        const struct sim_input* in = &s->queue[tail % SIM_QUEUE];
+
+        switch (in->type) {
+            case SIM_PLAY :
+                if (in->num) game_set_seed(g, in->num);
+
+                // A recorded round needs to know its seed
+                if (s->replay)
+                    replay_rewind(s->replay);
+                else if (s->record)
+                    replay_begin(s->record, g->seed, game_stream_size(), game_dict_size());
+
+                game_start(g);
+                (*round)++;
+                *playing = 1;
+            break;
+            // The replayed rounds only take the inputs of the replay
+            case SIM_TEXT :
+                if (!*playing || s->replay) break;
+
+                game_textinput(g, in->text);
+                if (s->record) replay_text(s->record, game_tick(g), in->text);
+            break;
+            case SIM_DELETE :
+                if (!*playing || s->replay) break;
+
+                game_input_delete(g, in->num);
+                if (s->record) replay_delete(s->record, game_tick(g), in->num);
+            break;
+        }
+    }
+
+    // The slots can be reused once they're read
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&s->tail, tail);
+    return 1;
+}
+
+// Copies the game into the thread's frame and swaps it in as the newest one
+static void sim_publish(struct sim* s, unsigned round, _Bool lost, Uint64 ticked, const struct histogram* late) {
+    struct sim_frame* f = &s->frames[s->back];
+
+    // Out of memory, the renderer keeps the previous frame
+    if (!game_snapshot(s->game, &f->game))
+        return;
+
+    f->round = round;
+    f->lost = lost;
+    f->ticked = ticked;
+    f->late = *late;
+
+    SDL_MemoryBarrierRelease();
+    s->back = SDL_AtomicSet(&s->latest, s->back | SIM_FRESH) & ~SIM_FRESH;
+}
+
+const struct sim_frame* sim_frame(struct sim* s) {
+    if (SDL_AtomicGet(&s->latest) & SIM_FRESH) {
+        s->front = SDL_AtomicSet(&s->latest, s->front) & ~SIM_FRESH;
+        SDL_MemoryBarrierAcquire();
+    }
+
+    return &s->frames[s->front];
+}
+
+static int sim_thread(void* data) {
+    struct sim* s = data;
+
+    const Uint64 freq = SDL_GetPerformanceFrequency(), tick = freq * TICK_MS / 1000;
+    Uint64 next = SDL_GetPerformanceCounter(), ticked = next;
+
+    struct histogram late;
+    histogram_reset(&late);
+
+    unsigned round = 0, measured = 0;
+    _Bool playing = 0, lost = 0;
+
+    while (SDL_AtomicGet(&s->running)) {
+
+        // The inputs go in before the ticks, like they do in a single threaded frame
+        _Bool changed = sim_drain(s, &round, &playing);
+
+        // Every round is measured on its own
+        if (round != measured) {
+            measured = round;
+            lost = 0;
+            histogram_reset(&late);
+        }
+
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (now > next + SIM_MAX_CATCHUP * tick)
+            next = now - SIM_MAX_CATCHUP * tick;
+
+        for (; next <= now; next += tick) {
+            if (!playing) continue;
+
+            histogram_add(&late, (now - next) * 1000000 / freq);
+            ticked = now;
+            changed = 1;
+
+            // The replayed inputs come in at exactly the same ticks as they were recorded at
+            if (s->replay)
+                replay_apply(s->replay, s->game);
+
+            if (!game_update(s->game)) {
+                playing = 0;
+                lost = 1;
+                if (s->record) replay_end(s->record, s->game);
+            }
+        }
+
+        if (changed)
+            sim_publish(s, round, lost, ticked, &late);
+
+        // Sleep until the next tick is due, or until an input comes in
+        now = SDL_GetPerformanceCounter();
+        Uint32 wait = next > now ? (next - now) * 1000 / freq : 0;
+        if (wait > 0) SDL_SemWaitTimeout(s->wake, wait);
+        else while (SDL_SemTryWait(s->wake) == 0);
+    }
+
+    return 0;
+}
+
+_Bool sim_open(struct sim* s, struct game* g, struct replay* record, struct replay* replay) {
+    memset(s, 0, sizeof(*s));
+    s->game = g;
+    s->record = record;
+    s->replay = replay;
+
+    // The renderer starts out with frame 0, an empty one, the thread fills 1 first
+    s->front = 0;
+    s->back = 1;
+    SDL_AtomicSet(&s->latest, 2);
+    SDL_AtomicSet(&s->running, 1);
+
+    if (!(s->wake = SDL_CreateSemaphore(0)))
+        return 0;
+
+    if (!(s->thread = SDL_CreateThread(sim_thread, "simulation", s))) {
+        SDL_DestroySemaphore(s->wake);
+        s->wake = NULL;
+        return 0;
+    }
+
+    return 1;
+}
+
+void sim_close(struct sim* s) {
+    if (s->thread) {
+        SDL_AtomicSet(&s->running, 0);
+        SDL_SemPost(s->wake);
+        SDL_WaitThread(s->thread, NULL);
+        s->thread = NULL;
+    }
+
+    SDL_DestroySemaphore(s->wake);
+    s->wake = NULL;
+
+    for (size_t i = 0; i < 3; i++)
+        game_snapshot_destroy(&s->frames[i].game);
+}
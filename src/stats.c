@@ -0,0 +1,98 @@
+#include "stats.h"
+
+#include <stdlib.h> // malloc
+#include <string.h> // memset
+
+_Bool stats_window_init(struct stats_window* w, size_t slots) {
+    memset(w, 0, sizeof(*w));
+    w->time = malloc(slots * sizeof(uint32_t));
+    w->count = malloc(slots * sizeof(uint32_t));
+    w->slots = slots;
+
+    if (!slots || !w->time || !w->count) {
+        stats_window_destroy(w);
+        return 0;
+    }
+    return 1;
+}
+
+void stats_window_destroy(struct stats_window* w) {
+    free(w->time);
+    free(w->count);
+    memset(w, 0, sizeof(*w));
+}
+
+void stats_window_reset(struct stats_window* w) {
+    w->head = w->len = 0;
+    w->sum = 0;
+}
+
+void stats_window_add(struct stats_window* w, uint32_t now, uint32_t count) {
+    size_t last = (w->head + w->len - 1) % w->slots;
+
+    // Merge into the newest event when it's at the same time, or when the ring is full
+    if (w->len && (w->time[last] == now || w->len == w->slots)) {
+        w->count[last] += count;
+    } else {
+        size_t i = (w->head + w->len) % w->slots;
+        w->time[i] = now;
+        w->count[i] = count;
+        w->len++;
+    }
+
+    w->sum += count;
+}
+
+uint64_t stats_window_sum(struct stats_window* w, uint32_t now) {
+    while (w->len && now - w->time[w->head] >= STATS_SPAN) {
+        w->sum -= w->count[w->head];
+        w->head = (w->head + 1) % w->slots;
+        w->len--;
+    }
+
+    return w->sum;
+}
+
+static size_t bucket_of(uint32_t v) {
+    if (v < 32) return v;
+
+    unsigned msb = 31;
+    while (!(v >> msb)) msb--;
+
+    // 16 buckets for every power of two
+    unsigned shift = msb - 4;
+    return (shift+1) * 16 + ((v >> shift) - 16);
+}
+
+// The largest value that goes into the bucket
+static uint32_t bucket_max(size_t b) {
+    if (b < 32) return b;
+
+    unsigned shift = b / 16 - 1;
+    return (((uint64_t)(16 + b % 16) + 1) << shift) - 1;
+}
+
+void histogram_reset(struct histogram* h) {
+    memset(h, 0, sizeof(*h));
+}
+
+void histogram_add(struct histogram* h, uint32_t value) {
+    h->bucket[bucket_of(value)]++;
+    h->count++;
+    h->sum += value;
+    if (value > h->max) h->max = value;
+}
+
+uint32_t histogram_percentile(const struct histogram* h, double p) {
+    if (!h->count) return 0;
+
+    uint64_t rank = (uint64_t)(p * h->count);
+    if (rank < 1) rank = 1;
+
+    uint64_t seen = 0;
+    for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++)
+        if ((seen += h->bucket[b]) >= rank)
+            return bucket_max(b) < h->max ? bucket_max(b) : h->max;
+
+    return h->max;
+}
@@ -1,34 +1,345 @@
 #include "text.h"
+#include "compose.h"
+#include "perf.h"
+#include "utf8.h"
 
 #include <stdio.h>
+#include <stdlib.h> // realloc
+#include <string.h> // strcmp, strncpy, memset
+
+// The glyphs that are rasterized while loading, a-z at FONT_SIZE
+#define GLYPHS 26
+
+// The most font sizes that are open at once, the least recently used one goes first
+#define SIZE_CACHE 8
+
+// The most glyphs in the atlas of one size, their hash table is never more than half full
+#define ATLAS_GLYPHS 2048
+#define GLYPH_SLOTS (2*ATLAS_GLYPHS)
+#define GLYPH_SHIFT 20 // 32 - log2(GLYPH_SLOTS)
+#define ATLAS_SHELVES 256
+#define NO_GLYPH UINT16_MAX
+
+// The widths at FONT_SIZE of the letters other than a-z that the layout has seen
+#define BASE_SLOTS 1024
 
 extern SDL_Renderer* ren;
 
-static TTF_Font* font;
-static SDL_Texture* alphabet[3][26];
+// A glyph in the atlas, the codepoint 0 means it's free
+struct glyph {
+    uint32_t cp;
+    SDL_Rect rect; // w is the advance as well
+    uint16_t shelf;
+};
+
+// A row of the atlas, the glyphs are packed left to right. When the atlas is full,
+// the least recently drawn row is emptied for the new glyphs
+struct shelf {
+    int y, h;
+    int x; // where the next glyph goes
+    unsigned long used;
+};
+
+// The font at one pixel size, with the glyph atlas that fills up with the glyphs as they are drawn.
+// All the glyphs are rendered white into the atlas, the three alphabet colors are applied per vertex when drawing
+struct font_size {
+    int px; // 0 if the entry is free
+    TTF_Font* font;
+    SDL_Texture* atlas;
+    SDL_Surface* pixels; // a copy of the atlas for the compositor, only when it's on
+    int atlas_side;
+
+    // The glyphs by codepoint: ASCII is a direct index, the rest is hashed with linear probing
+    uint16_t ascii[128];
+    struct { uint32_t cp; uint16_t glyph; } slots[GLYPH_SLOTS];
+
+    struct glyph glyphs[ATLAS_GLYPHS];
+    uint16_t free_glyphs[ATLAS_GLYPHS];
+    size_t free_count;
+
+    struct shelf shelves[ATLAS_SHELVES];
+    size_t shelf_count;
+    int shelf_top; // where the next shelf goes
+
+    unsigned long used;
+};
+
+static struct font_size sizes[SIZE_CACHE];
+static struct font_size* last_size; // most of the time, many glyphs of the same size are drawn in a row
+static unsigned long use_clock = 0;
+
+// The pixels per logical unit, all the positions and sizes outside of here are logical
+static float pixel_scale = 1;
+
+// The metrics at FONT_SIZE that the layout uses, independent of the pixel size
+static TTF_Font* base_font;
+static uint16_t base_width[GLYPHS];
+static struct { uint32_t cp; uint16_t w; } base_other[BASE_SLOTS];
+static SDL_Surface* preload[GLYPHS]; // the glyphs of a-z, between font_load and font_upload
+
+static const SDL_Color alphabet_color[3] = {
+    {100, 200, 255, 255},
+    {245, 245, 255, 255},
+    {255, 255, 255, 255}
+};
+
+// The queued glyph quads, submitted by render_cached_flush with a single draw call
+static SDL_Vertex* batch_verts;
+static int* batch_indices;
+static size_t batch_len = 0, batch_cap = 0; // in glyphs
+static SDL_Texture* batch_atlas;
+
+static SDL_Surface* glyph_render(TTF_Font* font, uint32_t cp) {
+    // The letters are all in the BMP
+    if (cp > 0xFFFF) return NULL;
+    return TTF_RenderGlyph_Solid(font, cp, (SDL_Color){255, 255, 255, 255});
+}
 
-static _Bool alphabet_cache(size_t index, SDL_Color col) {
+static size_t glyph_hash(uint32_t cp) {
+    return (cp * 0x9E3779B1u) >> GLYPH_SHIFT;
+}
 
-    for (size_t i = 0; i < 26; i++) {
+// The slot of the codepoint, or the free one where it would go
+static size_t glyph_slot(const struct font_size* fs, uint32_t cp) {
+    size_t i = glyph_hash(cp);
+    while (fs->slots[i].cp && fs->slots[i].cp != cp)
+        i = (i + 1) % GLYPH_SLOTS;
+    return i;
+}
 
-        SDL_Surface* surf = TTF_RenderGlyph_Solid(font, 'a'+i, col);
-        if (!surf) return 0;
+static uint16_t glyph_find(const struct font_size* fs, uint32_t cp) {
+    if (cp < 128) return fs->ascii[cp];
 
-        alphabet[index][i] = SDL_CreateTextureFromSurface(ren, surf);
-        if (!alphabet[index][i]) return 0;
-        SDL_FreeSurface(surf);
+    size_t i = glyph_slot(fs, cp);
+    return fs->slots[i].cp ? fs->slots[i].glyph : NO_GLYPH;
+}
+
+static void glyph_forget(struct font_size* fs, uint16_t glyph) {
+    uint32_t cp = fs->glyphs[glyph].cp;
+    fs->glyphs[glyph].cp = 0;
+    fs->free_glyphs[fs->free_count++] = glyph;
+
+    if (cp < 128) {
+        fs->ascii[cp] = NO_GLYPH;
+        return;
+    }
+
+    // Backward shift: the entries after the hole that would probe through it move into it
+    size_t hole = glyph_slot(fs, cp);
+    for (size_t i = (hole + 1) % GLYPH_SLOTS; fs->slots[i].cp; i = (i + 1) % GLYPH_SLOTS) {
+        size_t home = glyph_hash(fs->slots[i].cp);
+        if ((i - home) % GLYPH_SLOTS >= (i - hole) % GLYPH_SLOTS) {
+            fs->slots[hole] = fs->slots[i];
+            hole = i;
+        }
+    }
+    fs->slots[hole].cp = 0;
+}
+
+static void shelf_evict(struct font_size* fs, struct shelf* shelf) {
+    // The queued glyphs may be on it
+    if (fs->atlas == batch_atlas)
+        render_cached_flush();
+
+    uint16_t index = shelf - fs->shelves;
+    for (size_t i = 0; i < ATLAS_GLYPHS; i++)
+        if (fs->glyphs[i].cp && fs->glyphs[i].shelf == index)
+            glyph_forget(fs, i);
+
+    shelf->x = 0;
+    perf.glyph_evictions++;
+}
+
+// The least recently drawn shelf that has glyphs and is at least h high
+static struct shelf* shelf_victim(struct font_size* fs, int h) {
+    struct shelf* victim = NULL;
+    for (size_t i = 0; i < fs->shelf_count; i++) {
+        struct shelf* s = &fs->shelves[i];
+        if (s->x > 0 && s->h >= h && (!victim || s->used < victim->used))
+            victim = s;
+    }
+    return victim;
+}
+
+// Finds room for a w by h cell: on the shelf that fits it the tightest, else on a new shelf,
+// else on the least recently drawn shelf that is high enough
+static struct shelf* shelf_place(struct font_size* fs, int w, int h) {
+    if (w > fs->atlas_side || h > fs->atlas_side) return NULL;
+
+    struct shelf* best = NULL;
+    for (size_t i = 0; i < fs->shelf_count; i++) {
+        struct shelf* s = &fs->shelves[i];
+        if (s->h >= h && s->h <= h + h/2 && s->x + w <= fs->atlas_side && (!best || s->h < best->h))
+            best = s;
+    }
+
+    if (!best && fs->shelf_count < ATLAS_SHELVES && fs->shelf_top + h <= fs->atlas_side) {
+        best = &fs->shelves[fs->shelf_count++];
+        *best = (struct shelf){fs->shelf_top, h, 0, 0};
+        fs->shelf_top += h;
     }
 
+    if (!best && (best = shelf_victim(fs, h)))
+        shelf_evict(fs, best);
+
+    return best;
+}
+
+// Copies the glyph into the atlas, the surface is freed
+static uint16_t glyph_add(struct font_size* fs, uint32_t cp, SDL_Surface* glyph) {
+    uint16_t index = NO_GLYPH;
+    SDL_Surface* cell = NULL;
+
+    // Every glyph of the atlas is in use, the oldest shelf goes
+    struct shelf* shelf;
+    if (fs->free_count == 0 && (shelf = shelf_victim(fs, 0)))
+        shelf_evict(fs, shelf);
+
+    // With a pixel of padding right and below, so that the glyphs never bleed into each other
+    if (!glyph || fs->free_count == 0 || !(shelf = shelf_place(fs, glyph->w + 1, glyph->h + 1)))
+        goto quit;
+
+    cell = SDL_CreateRGBSurfaceWithFormat(0, glyph->w + 1, glyph->h + 1, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (!cell) goto quit;
+
+    // The glyph is colorkeyed, so only the glyph itself gets copied onto the transparent surface
+    SDL_BlitSurface(glyph, NULL, cell, NULL);
+
+    SDL_Rect rect = {shelf->x, shelf->y, glyph->w, glyph->h};
+    if (SDL_UpdateTexture(fs->atlas, &(SDL_Rect){rect.x, rect.y, cell->w, cell->h}, cell->pixels, cell->pitch))
+        goto quit;
+    shelf->x += cell->w;
+    perf.glyph_misses++;
+
+    // Copied as it is, the cell clears whatever glyph was there before
+    if (fs->pixels) {
+        SDL_SetSurfaceBlendMode(cell, SDL_BLENDMODE_NONE);
+        SDL_BlitSurface(cell, NULL, fs->pixels, &(SDL_Rect){rect.x, rect.y, cell->w, cell->h});
+    }
+
+    index = fs->free_glyphs[--fs->free_count];
+    fs->glyphs[index] = (struct glyph){cp, rect, shelf - fs->shelves};
+
+    if (cp < 128) fs->ascii[cp] = index;
+    else {
+        size_t i = glyph_slot(fs, cp);
+        fs->slots[i].cp = cp;
+        fs->slots[i].glyph = index;
+    }
+
+    quit:
+        SDL_FreeSurface(cell);
+        SDL_FreeSurface(glyph);
+
+    return index;
+}
+
+static const struct glyph* glyph_get(struct font_size* fs, uint32_t cp) {
+    uint16_t index = glyph_find(fs, cp);
+    if (index == NO_GLYPH && (index = glyph_add(fs, cp, glyph_render(fs->font, cp))) == NO_GLYPH)
+        return NULL;
+
+    return &fs->glyphs[index];
+}
+
+// An empty atlas, big enough for a thousand or so glyphs of the size
+static _Bool atlas_create(struct font_size* fs) {
+    fs->atlas_side = 256;
+    while (fs->atlas_side < fs->px * 32 && fs->atlas_side < 4096) fs->atlas_side *= 2;
+
+    fs->atlas = SDL_CreateTexture(ren, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC,
+                                  fs->atlas_side, fs->atlas_side);
+    if (!fs->atlas) return 0;
+
+    SDL_SetTextureBlendMode(fs->atlas, SDL_BLENDMODE_BLEND);
+    perf.texture_uploads++;
+
+    if (compose_enabled() && !(fs->pixels = SDL_CreateRGBSurfaceWithFormat(0, fs->atlas_side, fs->atlas_side, 32,
+                                                                           SDL_PIXELFORMAT_ARGB8888)))
+        return 0;
+
+    memset(fs->ascii, 0xff, sizeof(fs->ascii));
+    memset(fs->slots, 0, sizeof(fs->slots));
+    memset(fs->glyphs, 0, sizeof(fs->glyphs));
+
+    // The lowest glyphs get used first
+    fs->free_count = 0;
+    for (size_t i = ATLAS_GLYPHS; i-- > 0; )
+        fs->free_glyphs[fs->free_count++] = i;
+
+    fs->shelf_count = 0;
+    fs->shelf_top = 0;
     return 1;
 }
 
-static void alphabet_destroy(size_t index) {
-    for (size_t i = 0; i < 26; i++)
-        SDL_DestroyTexture(alphabet[index][i]);
+static void size_close(struct font_size* fs) {
+    // The queued glyphs may still need the atlas
+    if (fs->atlas && fs->atlas == batch_atlas)
+        render_cached_flush();
+
+    SDL_DestroyTexture(fs->atlas);
+    SDL_FreeSurface(fs->pixels);
+    TTF_CloseFont(fs->font);
+    memset(fs, 0, sizeof(*fs));
+
+    if (last_size == fs) last_size = NULL;
 }
 
+// The font of the pixel size, opened if it isn't yet, with its atlas too if asked for
+static struct font_size* size_get(int px, _Bool atlas) {
+    struct font_size* fs = last_size;
+
+    if (!fs || fs->px != px) {
+        fs = NULL;
+        struct font_size* victim = &sizes[0];
+        for (size_t i = 0; i < SIZE_CACHE && !fs; i++)
+            if (sizes[i].px == px)
+                fs = &sizes[i];
+            else if (!sizes[i].px || (victim->px && sizes[i].used < victim->used))
+                victim = &sizes[i];
+
+        if (!fs) {
+            size_close(victim);
+            if (!(victim->font = TTF_OpenFont(FONT_FILE, px))) return NULL;
+            victim->px = px;
+            fs = victim;
+        }
+    }
 
-_Bool font_init() {
+    if (atlas && !fs->atlas && !atlas_create(fs))
+        return NULL;
+
+    fs->used = ++use_clock;
+    last_size = fs;
+    return fs;
+}
+
+// The pixel size of the text drawn at the scale of FONT_SIZE
+static int size_px(double scale) {
+    int px = (int)(FONT_SIZE * scale * pixel_scale + 0.5);
+    return px > 0 ? px : 1;
+}
+
+static _Bool batch_reserve(size_t glyphs) {
+    if (batch_len + glyphs <= batch_cap)
+        return 1;
+
+    size_t cap = batch_cap ? batch_cap : 256;
+    while (cap < batch_len + glyphs) cap *= 2;
+
+    SDL_Vertex* verts = realloc(batch_verts, cap * 4 * sizeof(SDL_Vertex));
+    if (!verts) return 0;
+    batch_verts = verts;
+
+    int* indices = realloc(batch_indices, cap * 6 * sizeof(int));
+    if (!indices) return 0;
+    batch_indices = indices;
+
+    batch_cap = cap;
+    return 1;
+}
+
+_Bool font_load() {
 
     // Initialize the font
     if (TTF_Init()) {
@@ -36,90 +347,259 @@ _Bool font_init() {
         return 0;
     }
 
-    font = TTF_OpenFont("res/font.ttf", 32);
-    if (font == NULL) {
+    if (!(base_font = TTF_OpenFont(FONT_FILE, FONT_SIZE))) {
         fprintf(stderr, "Failed to load the font file: %s\n", TTF_GetError());
         return 0;
     }
-    
-    // Cache the three different colors of alphabets
-    if (!alphabet_cache(0, (SDL_Color){100, 200, 255, 255}) |
-        !alphabet_cache(1, (SDL_Color){245, 245, 255, 255}) |
-        !alphabet_cache(2, (SDL_Color){255, 255, 255, 255}))  {
-        fprintf(stderr, "Failed to cache alphabets\n");
-        return 0;
+
+    // Rasterize the alphabet, every other glyph is rasterized the first time it's drawn
+    for (size_t i = 0; i < GLYPHS; i++) {
+        if (!(preload[i] = glyph_render(base_font, 'a'+i))) {
+            fprintf(stderr, "Failed to cache alphabets\n");
+            return 0;
+        }
+        base_width[i] = preload[i]->w;
     }
 
     return 1;
 }
 
+_Bool font_upload() {
+    struct font_size* fs = size_get(FONT_SIZE, 1);
+
+    _Bool ok = fs != NULL;
+    for (size_t i = 0; i < GLYPHS; i++) {
+        // The surfaces are taken over either way
+        ok = ok && glyph_add(fs, 'a'+i, preload[i]) != NO_GLYPH;
+        if (!ok) SDL_FreeSurface(preload[i]);
+        preload[i] = NULL;
+    }
+
+    if (!ok) fprintf(stderr, "Failed to upload the alphabet: %s\n", SDL_GetError());
+    return ok;
+}
+
+_Bool font_init() {
+    return font_load() && font_upload();
+}
+
 void font_dealloc() {
-    alphabet_destroy(0);
-    alphabet_destroy(1);
-    alphabet_destroy(2);
+    for (size_t i = 0; i < SIZE_CACHE; i++)
+        size_close(&sizes[i]);
+    for (size_t i = 0; i < GLYPHS; i++) {
+        SDL_FreeSurface(preload[i]);
+        preload[i] = NULL;
+    }
+
+    TTF_CloseFont(base_font);
+    base_font = NULL;
+    memset(base_other, 0, sizeof(base_other));
+
+    free(batch_verts);
+    free(batch_indices);
+    batch_verts = NULL;
+    batch_indices = NULL;
+    batch_len = batch_cap = 0;
+    batch_atlas = NULL;
 
-    TTF_CloseFont(font);
     TTF_Quit();
 }
 
-unsigned render_char_cached(size_t apb_index, const char c, int x, int y, double scale) {
-    SDL_Texture* glyph = alphabet[apb_index][c-'a']; 
-    
-    SDL_Rect dstr;
-    dstr.x = x;
-    dstr.y = y;
-    if (SDL_QueryTexture(glyph, NULL, NULL, &dstr.w, &dstr.h)) 
+void text_set_pixel_scale(float scale) {
+    pixel_scale = scale > 0 ? scale : 1;
+}
+
+float text_pixel_scale() {
+    return pixel_scale;
+}
+
+float render_char_cached(size_t apb_index, uint32_t cp, float x, float y, double scale) {
+    struct font_size* fs = size_get(size_px(scale), 1);
+    if (!fs) return 0;
+
+    // Rasterizing it can empty a shelf, which flushes the batch
+    const struct glyph* glyph = glyph_get(fs, cp);
+    if (!glyph) return 0;
+    fs->shelves[glyph->shelf].used = fs->used;
+
+    // One texel per pixel
+    const SDL_Rect* src = &glyph->rect;
+    float w = src->w / pixel_scale, h = src->h / pixel_scale;
+
+    // A composited frame gets the glyph right away, from the copy of the atlas
+    if (compose_active()) {
+        compose_blit(fs->pixels, src, (SDL_FRect){x, y, w, h}, alphabet_color[apb_index]);
+        return w;
+    }
+
+    // A batch has a single atlas
+    if (fs->atlas != batch_atlas) {
+        render_cached_flush();
+        batch_atlas = fs->atlas;
+    }
+
+    if (!batch_reserve(1))
         return 0;
 
-    dstr.w = (int)(dstr.w*scale);
-    dstr.h = (int)(dstr.h*scale);
+    const SDL_Color col = alphabet_color[apb_index];
 
-    SDL_RenderCopy(ren, glyph, NULL, &dstr);
+    float side = fs->atlas_side;
+    float u0 = src->x / side, u1 = (src->x + src->w) / side;
+    float v0 = src->y / side, v1 = (src->y + src->h) / side;
 
-    return dstr.w;
+    SDL_Vertex* v = &batch_verts[batch_len*4];
+    v[0] = (SDL_Vertex){{x,   y  }, col, {u0, v0}};
+    v[1] = (SDL_Vertex){{x+w, y  }, col, {u1, v0}};
+    v[2] = (SDL_Vertex){{x+w, y+h}, col, {u1, v1}};
+    v[3] = (SDL_Vertex){{x,   y+h}, col, {u0, v1}};
+
+    int base = batch_len*4;
+    int* i = &batch_indices[batch_len*6];
+    i[0] = base; i[1] = base+1; i[2] = base+2;
+    i[3] = base; i[4] = base+2; i[5] = base+3;
+
+    batch_len++;
+
+    return w;
+}
+
+void render_cached_flush() {
+    if (batch_len == 0)
+        return;
+
+    SDL_RenderGeometry(ren, batch_atlas, batch_verts, batch_len*4, batch_indices, batch_len*6);
+    perf.draw_calls++;
+
+    batch_len = 0;
 }
 
-void render_string_cached(size_t apb_index, const char* str, int x, int y, double scale) {
-    unsigned offset = 0;
-    for (; *str; str++)
-        offset += render_char_cached(apb_index, *str, x+offset, y, scale);
+void render_string_cached(size_t apb_index, const char* str, float x, float y, double scale) {
+    float offset = 0;
+    while (*str)
+        offset += render_char_cached(apb_index, utf8_next(&str), x+offset, y, scale);
+
+    render_cached_flush();
 }
 
 unsigned cached_string_width(size_t apb_index, const char* str) {
+    // All the alphabets share the same glyph metrics
+    (void)apb_index;
+
     unsigned sum = 0;
 
-    for (; *str; str++) {
-        int wid;
-        SDL_QueryTexture(alphabet[apb_index][*str-'a'], NULL, NULL, &wid, NULL);
-        sum += wid;
-    }
+    while (*str)
+        sum += glyph_advance(utf8_next(&str));
 
     return sum;
 }
 
-SDL_Texture* string_cache(const char* str, SDL_Color col) {
-    SDL_Surface* surf = TTF_RenderText_Solid(font, str, col);
+void glyph_widths(uint8_t widths[26]) {
+    for (size_t i = 0; i < GLYPHS; i++)
+        widths[i] = base_width[i];
+}
+
+unsigned glyph_advance(uint32_t cp) {
+    if (cp - 'a' < GLYPHS) return base_width[cp-'a'];
+
+    // Measured once, by rasterizing it like the atlas does
+    size_t i = glyph_hash(cp) % BASE_SLOTS;
+    for (size_t n = 0; n < BASE_SLOTS && base_other[i].cp; n++, i = (i + 1) % BASE_SLOTS)
+        if (base_other[i].cp == cp) return base_other[i].w;
+
+    SDL_Surface* surf = glyph_render(base_font, cp);
+    unsigned w = surf ? surf->w : 0;
+    SDL_FreeSurface(surf);
+
+    // Once the table is full, the rest are measured every time
+    if (!base_other[i].cp) {
+        base_other[i].cp = cp;
+        base_other[i].w = w;
+    }
+    return w;
+}
+
+SDL_Texture* string_cache(const char* str, SDL_Color col, double scale) {
+    struct font_size* fs = size_get(size_px(scale), 0);
+    if (!fs) return NULL;
+
+    SDL_Surface* surf = TTF_RenderUTF8_Solid(fs->font, str, col);
     if (!surf) return NULL;
     SDL_Texture* tex = SDL_CreateTextureFromSurface(ren, surf);
     SDL_FreeSurface(surf);
+    perf.texture_uploads++;
     return tex;
 }
 
-void render_string(const char* str, int x, int y, double scale) {
+void render_string(const char* str, float x, float y, double scale) {
+
+    struct font_size* fs = size_get(size_px(scale), 0);
+    if (!fs) return;
 
-    SDL_Surface* surf = TTF_RenderText_Solid(font, str, (SDL_Color){255,255,255,255});
+    SDL_Surface* surf = TTF_RenderUTF8_Solid(fs->font, str, (SDL_Color){255,255,255,255});
     if (!surf) return;
     SDL_Texture* tex = SDL_CreateTextureFromSurface(ren, surf);
     if (!tex) return;
+    perf.texture_uploads++;
 
-    SDL_Rect dstr = {x, y, surf->w, surf->h};
-
-    dstr.w = (int)(dstr.w*scale);
-    dstr.h = (int)(dstr.h*scale);
-
-    SDL_RenderCopy(ren, tex, NULL, &dstr);
+    SDL_RenderCopyF(ren, tex, NULL, &(SDL_FRect){x, y, surf->w / pixel_scale, surf->h / pixel_scale});
+    perf.draw_calls++;
 
     SDL_FreeSurface(surf);
     SDL_DestroyTexture(tex);
 
 }
+
+void render_label(struct text_label* label, const char* str, float x, float y, double scale) {
+
+    int px = size_px(scale);
+
+    // A composited frame blits the label from memory instead of a texture
+    _Bool composed = compose_active();
+
+    if (label->px == px && !strcmp(label->str, str) && (composed ? label->surf != NULL : label->tex != NULL))
+        perf.label_hits++;
+    else {
+        perf.label_misses++;
+
+        label_destroy(label);
+
+        struct font_size* fs = size_get(px, 0);
+        if (!fs) return;
+
+        SDL_Surface* surf = TTF_RenderUTF8_Solid(fs->font, str, (SDL_Color){255,255,255,255});
+        if (!surf) return;
+        label->w = surf->w;
+        label->h = surf->h;
+
+        if (composed) {
+            // The text is colorkeyed, only the text itself gets copied onto the transparent surface
+            if ((label->surf = SDL_CreateRGBSurfaceWithFormat(0, surf->w, surf->h, 32, SDL_PIXELFORMAT_ARGB8888)))
+                SDL_BlitSurface(surf, NULL, label->surf, NULL);
+        } else if ((label->tex = SDL_CreateTextureFromSurface(ren, surf)))
+            perf.texture_uploads++;
+
+        SDL_FreeSurface(surf);
+        if (!label->tex && !label->surf) return;
+
+        label->px = px;
+        strncpy(label->str, str, sizeof(label->str)-1);
+        label->str[sizeof(label->str)-1] = '\0';
+    }
+
+    SDL_FRect rect = {x, y, label->w / pixel_scale, label->h / pixel_scale};
+    if (composed) {
+        compose_blit(label->surf, NULL, rect, (SDL_Color){255,255,255,255});
+        return;
+    }
+
+    SDL_RenderCopyF(ren, label->tex, NULL, &rect);
+    perf.draw_calls++;
+}
+
+void label_destroy(struct text_label* label) {
+    SDL_DestroyTexture(label->tex);
+    SDL_FreeSurface(label->surf);
+    label->tex = NULL;
+    label->surf = NULL;
+    label->str[0] = '\0';
+}
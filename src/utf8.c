@@ -0,0 +1,127 @@
+#include "utf8.h"
+
+uint32_t utf8_decode(const char** s, const char* end) {
+    const unsigned char* c = (const unsigned char*)*s;
+    size_t avail = end - *s;
+
+    (*s)++;
+    if (c[0] < 0x80) return c[0];
+
+    // The length of the sequence and the smallest codepoint that needs it
+    size_t n;
+    uint32_t cp, min;
+    if (c[0] >= 0xC2 && c[0] < 0xE0) { n = 2; cp = c[0] & 0x1F; min = 0x80; }
+    else if (c[0] >= 0xE0 && c[0] < 0xF0) { n = 3; cp = c[0] & 0x0F; min = 0x800; }
+    else if (c[0] >= 0xF0 && c[0] < 0xF5) { n = 4; cp = c[0] & 0x07; min = 0x10000; }
+    else return UTF8_INVALID;
+
+    if (n > avail) return UTF8_INVALID;
+
+    for (size_t i = 1; i < n; i++) {
+        if ((c[i] & 0xC0) != 0x80) return UTF8_INVALID;
+        cp = cp << 6 | (c[i] & 0x3F);
+    }
+
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp < 0xE000))
+        return UTF8_INVALID;
+
+    *s += n-1;
+    return cp;
+}
+
+size_t utf8_encode(uint32_t cp, char out[UTF8_MAX]) {
+    if (cp < 0x80) {
+        out[0] = cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = 0xC0 | cp >> 6;
+        out[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    }
+    if (cp < 0x10000) {
+        if (cp >= 0xD800 && cp < 0xE000) return 0;
+        out[0] = 0xE0 | cp >> 12;
+        out[1] = 0x80 | (cp >> 6 & 0x3F);
+        out[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+    if (cp <= 0x10FFFF) {
+        out[0] = 0xF0 | cp >> 18;
+        out[1] = 0x80 | (cp >> 12 & 0x3F);
+        out[2] = 0x80 | (cp >> 6 & 0x3F);
+        out[3] = 0x80 | (cp & 0x3F);
+        return 4;
+    }
+    return 0;
+}
+
+// The upper and lowercase letters of a block alternate, the uppercase one is at the even
+// (or the odd) codepoints
+static uint32_t pair_lower(uint32_t cp, uint32_t upper_parity) {
+    return (cp & 1) == upper_parity ? cp + 1 : cp;
+}
+
+uint32_t utf8_letter(uint32_t cp) {
+    // Basic Latin
+    if (cp >= 'a' && cp <= 'z') return cp;
+    if (cp >= 'A' && cp <= 'Z') return cp + 32;
+    if (cp < 0xC0) return 0;
+
+    // Latin-1, without the multiplication and the division signs
+    if (cp == 0xD7 || cp == 0xF7) return 0;
+    if (cp < 0xDF) return cp + 0x20;
+    if (cp < 0x100) return cp;
+
+    // Latin Extended-A, the dotted I and a few letters without a case are left as they are
+    if (cp < 0x130) return pair_lower(cp, 0);
+    if (cp < 0x132) return cp;
+    if (cp < 0x138) return pair_lower(cp, 0);
+    if (cp == 0x138) return cp;
+    if (cp < 0x149) return pair_lower(cp, 1);
+    if (cp == 0x149) return cp;
+    if (cp < 0x178) return pair_lower(cp, 0);
+    if (cp == 0x178) return 0xFF;
+    if (cp < 0x17F) return pair_lower(cp, 1);
+
+    // Latin Extended-B is too irregular to lowercase by ranges, its letters are kept as they are
+    if (cp < 0x250) return cp;
+
+    // Greek
+    if (cp == 0x386) return 0x3AC;
+    if (cp >= 0x388 && cp <= 0x38A) return cp + 37;
+    if (cp == 0x38C) return 0x3CC;
+    if (cp == 0x38E || cp == 0x38F) return cp + 63;
+    if (cp == 0x390) return cp;
+    if (cp >= 0x391 && cp <= 0x3A9) return cp == 0x3A2 ? 0 : cp + 32;
+    if (cp >= 0x3AA && cp <= 0x3AB) return cp + 32;
+    if (cp >= 0x3AC && cp <= 0x3CE) return cp;
+
+    // Cyrillic
+    if (cp >= 0x400 && cp < 0x410) return cp + 0x50;
+    if (cp >= 0x410 && cp < 0x430) return cp + 0x20;
+    if (cp >= 0x430 && cp < 0x460) return cp;
+    if (cp >= 0x460 && cp < 0x482) return pair_lower(cp, 0);
+    if (cp >= 0x48A && cp < 0x4C0) return pair_lower(cp, 0);
+    if (cp == 0x4C0) return 0x4CF;
+    if (cp >= 0x4C1 && cp < 0x4CF) return pair_lower(cp, 1);
+    if (cp == 0x4CF) return cp;
+    if (cp >= 0x4D0 && cp < 0x530) return pair_lower(cp, 0);
+
+    return 0;
+}
+
+size_t utf8_length(const char* s) {
+    size_t n = 0;
+    for (; *s; s++)
+        n += ((unsigned char)*s & 0xC0) != 0x80;
+    return n;
+}
+
+size_t utf8_back(const char* s, size_t len) {
+    if (len == 0) return 0;
+
+    len--;
+    while (len > 0 && ((unsigned char)s[len] & 0xC0) == 0x80) len--;
+    return len;
+}
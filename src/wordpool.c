@@ -0,0 +1,73 @@
+#include "wordpool.h"
+
+#include <stdlib.h> // malloc
+
+_Bool wordpool_init(struct wordpool* p, size_t size) {
+    if (size > UINT32_MAX)
+        return 0;
+
+    p->words = malloc(size * sizeof(uint32_t));
+    p->slot = malloc(size * sizeof(uint32_t));
+    p->size = p->unused = size;
+
+    if (!p->words || !p->slot) {
+        wordpool_destroy(p);
+        return 0;
+    }
+
+    for (size_t i = 0; i < size; i++)
+        p->words[i] = p->slot[i] = i;
+
+    return 1;
+}
+
+void wordpool_destroy(struct wordpool* p) {
+    free(p->words);
+    free(p->slot);
+    p->words = p->slot = NULL;
+    p->size = p->unused = 0;
+}
+
+void wordpool_reset(struct wordpool* p) {
+    // The picks go by position, so the order has to be the same as after wordpool_init,
+    // otherwise a seed picks different words in every round
+    for (size_t i = 0; i < p->size; i++)
+        p->words[i] = p->slot[i] = i;
+    p->unused = p->size;
+}
+
+// Swap two positions in the words array and keep the slots in sync
+static void swap(struct wordpool* p, size_t a, size_t b) {
+    uint32_t wa = p->words[a], wb = p->words[b];
+    p->words[a] = wb; p->slot[wb] = a;
+    p->words[b] = wa; p->slot[wa] = b;
+}
+
+size_t wordpool_pick(struct wordpool* p, struct rng* r) {
+    if (p->unused == 0)
+        return p->words[rng_range(r, p->size)];
+
+    size_t pos = rng_range(r, p->unused);
+    size_t word = p->words[pos];
+
+    // Move it right behind the boundary, which then moves over it
+    swap(p, pos, --p->unused);
+
+    return word;
+}
+
+_Bool wordpool_take(struct wordpool* p, size_t word) {
+    if (p->slot[word] >= p->unused)
+        return 0;
+
+    swap(p, p->slot[word], --p->unused);
+    return 1;
+}
+
+void wordpool_release(struct wordpool* p, size_t word) {
+    // Already unused, which happens when the pool ran dry and a word was picked twice
+    if (p->slot[word] < p->unused)
+        return;
+
+    swap(p, p->slot[word], p->unused++);
+}
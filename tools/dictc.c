@@ -0,0 +1,73 @@
+// Compiles a text word list into the binary dictionary that the game loads without any parsing,
+// together with the pixel width of every word in the game's font
+// Usage: dictc <word list> <output>
+
+#include <stdio.h> // fprintf
+#include <stdlib.h> // malloc
+
+#include <SDL.h>
+#include <SDL_ttf.h>
+
+#include "dict.h"
+#include "text.h"
+
+static TTF_Font* font;
+
+// The same width as the game's atlas has for the glyph
+static unsigned other_width(uint32_t cp) {
+    SDL_Surface* surf = cp <= 0xFFFF ? TTF_RenderGlyph_Solid(font, cp, (SDL_Color){255, 255, 255, 255}) : NULL;
+    unsigned w = surf ? surf->w : 0;
+    SDL_FreeSurface(surf);
+    return w;
+}
+
+int main(int argc, char *argv[]) {
+
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <word list> <output>\n", argv[0]);
+        return 1;
+    }
+
+    if (TTF_Init()) {
+        fprintf(stderr, "SDL_ttf failed to initialize : %s\n", TTF_GetError());
+        return 1;
+    }
+
+    font = TTF_OpenFont(FONT_FILE, FONT_SIZE);
+    if (!font) {
+        fprintf(stderr, "Failed to load the font file: %s\n", TTF_GetError());
+        return 1;
+    }
+
+    // The same glyphs as the ones in the game's atlas
+    uint8_t glyph_width[26];
+    for (size_t i = 0; i < 26; i++) {
+        SDL_Surface* surf = TTF_RenderGlyph_Solid(font, 'a'+i, (SDL_Color){255, 255, 255, 255});
+        if (!surf) {
+            fprintf(stderr, "Failed to render a glyph: %s\n", TTF_GetError());
+            return 1;
+        }
+        glyph_width[i] = surf->w;
+        SDL_FreeSurface(surf);
+    }
+
+    struct dict d;
+    if (!dict_load(&d, argv[1])) {
+        fprintf(stderr, "Failed to load %s\n", argv[1]);
+        return 1;
+    }
+
+    _Bool ok = dict_measure(&d, glyph_width, other_width) && dict_save_bin(&d, argv[2], argv[1], glyph_width);
+
+    TTF_CloseFont(font);
+    TTF_Quit();
+
+    if (ok)
+        fprintf(stdout, "Compiled %zu words into %s\n", d.size, argv[2]);
+    else
+        fprintf(stderr, "Failed to write %s\n", argv[2]);
+
+    dict_destroy(&d);
+
+    return !ok;
+}